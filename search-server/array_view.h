@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Неизменяемый непрерывный массив в чужой памяти: в векторе или в
+// отображённом в память файле. Валиден, пока жив владелец памяти.
+template <typename Value>
+class ArrayView {
+public:
+    ArrayView() = default;
+
+    ArrayView(const Value* data, size_t size)
+        : data_(data)
+        , size_(size)
+    {
+    }
+
+    explicit ArrayView(const std::vector<Value>& values)
+        : data_(values.data())
+        , size_(values.size())
+    {
+    }
+
+    const Value* begin() const {
+        return data_;
+    }
+
+    const Value* end() const {
+        return data_ + size_;
+    }
+
+    const Value* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const Value& operator[](size_t index) const {
+        return data_[index];
+    }
+
+private:
+    const Value* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,186 @@
+#include "async_search_server.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+AsyncSearchServer::AsyncSearchServer(const SearchServer& search_server, size_t thread_count, size_t queue_capacity)
+    : search_server_(search_server)
+    , queue_capacity_(std::max<size_t>(queue_capacity, 1))
+{
+    for (size_t i = 0; i < std::max<size_t>(thread_count, 1); ++i) {
+        workers_.emplace_back([this] {
+            RunWorker();
+            });
+    }
+}
+
+AsyncSearchServer::~AsyncSearchServer() {
+    std::vector<std::unique_ptr<Request>> pending;
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+        for (auto& queue : queues_) {
+            std::move(queue.begin(), queue.end(), std::back_inserter(pending));
+            queue.clear();
+        }
+        queue_size_ = 0;
+    }
+    request_added_.notify_all();
+    request_taken_.notify_all();
+    for (const auto& request : pending) {
+        Reject(*request, "Сервер остановлен");
+        if (request->on_ready) {
+            request->on_ready();
+        }
+    }
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+std::future<std::vector<Document>> AsyncSearchServer::Submit(std::string raw_query, QueryPriority priority, QueryDeadline deadline) {
+    return Submit(std::move(raw_query), DocumentStatus::ACTUAL, priority, deadline);
+}
+
+std::future<std::vector<Document>> AsyncSearchServer::SubmitWait(std::string raw_query, QueryPriority priority, QueryDeadline deadline) {
+    return SubmitWait(std::move(raw_query), DocumentStatus::ACTUAL, priority, deadline);
+}
+
+std::future<std::vector<Document>> AsyncSearchServer::SubmitSearch(SearchFunction search, QueryPriority priority,
+    QueryDeadline deadline, OverflowAction overflow_action) {
+    auto request = std::make_unique<Request>();
+    request->search = std::move(search);
+    request->deadline = deadline;
+    auto result = request->promise.get_future();
+    Enqueue(std::move(request), priority, overflow_action);
+    return result;
+}
+
+size_t AsyncSearchServer::GetQueueSize() const {
+    std::lock_guard lock(mutex_);
+    return queue_size_;
+}
+
+// Отклонение и вытеснение завершают запросы уже после снятия блокировки,
+// так как on_ready может продолжить корутину
+bool AsyncSearchServer::Enqueue(std::unique_ptr<Request> request, QueryPriority priority, OverflowAction overflow_action) {
+    const size_t priority_index = static_cast<size_t>(priority);
+    std::unique_ptr<Request> evicted;
+    std::unique_lock lock(mutex_);
+
+    if (overflow_action == OverflowAction::WAIT) {
+        const auto has_room = [this] {
+            return stopping_ || queue_size_ < queue_capacity_;
+        };
+        if (!request->deadline.IsSet()) {
+            request_taken_.wait(lock, has_room);
+        }
+        else if (!request_taken_.wait_until(lock, request->deadline.GetTime(), has_room)) {
+            lock.unlock();
+            request->promise.set_exception(std::make_exception_ptr(
+                QueryDeadlineExceeded("Истёк срок выполнения запроса в ожидании места в очереди")));
+            return false;
+        }
+    }
+    if (stopping_) {
+        lock.unlock();
+        Reject(*request, "Сервер остановлен");
+        return false;
+    }
+
+    if (queue_size_ == queue_capacity_) {
+        for (size_t index = PRIORITY_COUNT; index-- > priority_index + 1;) {
+            if (!queues_[index].empty()) {
+                evicted = std::move(queues_[index].back());
+                queues_[index].pop_back();
+                --queue_size_;
+                break;
+            }
+        }
+        if (!evicted) {
+            lock.unlock();
+            Reject(*request, "Очередь запросов переполнена");
+            return false;
+        }
+    }
+    queues_[priority_index].push_back(std::move(request));
+    ++queue_size_;
+    lock.unlock();
+    request_added_.notify_one();
+
+    if (evicted) {
+        Reject(*evicted, "Запрос вытеснен из очереди более приоритетным");
+        if (evicted->on_ready) {
+            evicted->on_ready();
+        }
+    }
+    return true;
+}
+
+void AsyncSearchServer::RunWorker() {
+    while (true) {
+        std::unique_ptr<Request> request;
+        {
+            std::unique_lock lock(mutex_);
+            request_added_.wait(lock, [this] {
+                return stopping_ || queue_size_ > 0;
+                });
+            if (stopping_) {
+                return;
+            }
+            for (auto& queue : queues_) {
+                if (!queue.empty()) {
+                    request = std::move(queue.front());
+                    queue.pop_front();
+                    break;
+                }
+            }
+            --queue_size_;
+        }
+        request_taken_.notify_one();
+
+        try {
+            request->deadline.Check();
+            request->promise.set_value(request->search(search_server_, request->deadline));
+        }
+        catch (...) {
+            request->promise.set_exception(std::current_exception());
+        }
+        if (request->on_ready) {
+            request->on_ready();
+        }
+    }
+}
+
+void AsyncSearchServer::Reject(Request& request, const char* reason) {
+    request.promise.set_exception(std::make_exception_ptr(QueryRejected(reason)));
+}
+
+#ifdef ASYNC_SEARCH_SERVER_COROUTINES
+AsyncSearchServer::SearchAwaiter AsyncSearchServer::Search(std::string raw_query, QueryPriority priority, QueryDeadline deadline) {
+    return Search(std::move(raw_query), DocumentStatus::ACTUAL, priority, deadline);
+}
+
+AsyncSearchServer::SearchAwaiter::SearchAwaiter(AsyncSearchServer& server, SearchFunction search, QueryPriority priority,
+    QueryDeadline deadline)
+    : server_(server)
+    , search_(std::move(search))
+    , priority_(priority)
+    , deadline_(deadline)
+{
+}
+
+// После постановки в очередь корутина может продолжиться в потоке пула ещё
+// до возврата отсюда, поэтому после Enqueue к полям объекта не обращаемся
+bool AsyncSearchServer::SearchAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    auto request = std::make_unique<Request>();
+    request->search = std::move(search_);
+    request->deadline = deadline_;
+    request->on_ready = [handle] {
+        handle.resume();
+    };
+    result_ = request->promise.get_future();
+    return server_.Enqueue(std::move(request), priority_, OverflowAction::SHED);
+}
+#endif
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "search_server.h"
+#include "query_deadline.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define ASYNC_SEARCH_SERVER_COROUTINES
+#endif
+
+// Запрос не принят: очередь переполнена или сервер останавливается
+class QueryRejected : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Классы запросов в порядке убывания приоритета
+enum class QueryPriority {
+    HIGH,
+    NORMAL,
+    LOW,
+};
+
+// Асинхронный приём запросов к SearchServer. Запросы ждут в ограниченной
+// очереди и выполняются пулом потоков, каждый запрос в одном потоке; первым
+// берётся самый старый запрос высшего из непустых классов. Когда очередь
+// полна, Submit вытесняет самый новый запрос низшего класса, если он ниже
+// нового, а иначе отклоняет новый; SubmitWait вместо этого ждёт места.
+// Запрос, срок которого наступил в очереди, не выполняется, а начатый
+// прерывается в обходе списков вхождений (см. FindTopDocumentsWithDeadline).
+// SearchServer должен жить дольше этого объекта.
+class AsyncSearchServer {
+public:
+    AsyncSearchServer(const SearchServer& search_server, size_t thread_count, size_t queue_capacity);
+
+    AsyncSearchServer(const AsyncSearchServer&) = delete;
+    AsyncSearchServer& operator=(const AsyncSearchServer&) = delete;
+
+    // Отклоняет ждущие запросы и дожидается выполняющихся
+    ~AsyncSearchServer();
+
+    // Результат как у FindTopDocuments(raw_query); ошибки разбора,
+    // QueryDeadlineExceeded и QueryRejected приходят через future
+    std::future<std::vector<Document>> Submit(std::string raw_query,
+        QueryPriority priority = QueryPriority::NORMAL, QueryDeadline deadline = QueryDeadline());
+
+    // Результат как у FindTopDocuments(raw_query, document_predicate), где
+    // document_predicate - статус или предикат; предикат копируется в запрос
+    // и вызывается в потоке пула
+    template <typename DocumentPredicate>
+    std::future<std::vector<Document>> Submit(std::string raw_query, DocumentPredicate document_predicate,
+        QueryPriority priority = QueryPriority::NORMAL, QueryDeadline deadline = QueryDeadline());
+
+    // Как Submit, но при полной очереди ждёт места до наступления срока
+    std::future<std::vector<Document>> SubmitWait(std::string raw_query,
+        QueryPriority priority = QueryPriority::NORMAL, QueryDeadline deadline = QueryDeadline());
+
+    template <typename DocumentPredicate>
+    std::future<std::vector<Document>> SubmitWait(std::string raw_query, DocumentPredicate document_predicate,
+        QueryPriority priority = QueryPriority::NORMAL, QueryDeadline deadline = QueryDeadline());
+
+    size_t GetQueueSize() const;
+
+#ifdef ASYNC_SEARCH_SERVER_COROUTINES
+    class SearchAwaiter;
+
+    // co_await Search(...) продолжает корутину в потоке пула, когда запрос
+    // выполнен, или сразу, если он не принят
+    SearchAwaiter Search(std::string raw_query,
+        QueryPriority priority = QueryPriority::NORMAL, QueryDeadline deadline = QueryDeadline());
+
+    template <typename DocumentPredicate>
+    SearchAwaiter Search(std::string raw_query, DocumentPredicate document_predicate,
+        QueryPriority priority = QueryPriority::NORMAL, QueryDeadline deadline = QueryDeadline());
+#endif
+
+private:
+    static constexpr size_t PRIORITY_COUNT = 3;
+
+    // Выполняет запрос со сроком, записанным в Request
+    using SearchFunction = std::function<std::vector<Document>(const SearchServer&, const QueryDeadline&)>;
+
+    struct Request {
+        SearchFunction search;
+        QueryDeadline deadline;
+        std::promise<std::vector<Document>> promise;
+        // Вызывается после того, как результат записан в promise
+        std::function<void()> on_ready;
+    };
+
+    enum class OverflowAction {
+        SHED,
+        WAIT,
+    };
+
+    const SearchServer& search_server_;
+    const size_t queue_capacity_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable request_added_;
+    std::condition_variable request_taken_;
+    std::array<std::deque<std::unique_ptr<Request>>, PRIORITY_COUNT> queues_;
+    size_t queue_size_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+
+    // Возвращает false, если запрос не принят; тогда его promise уже
+    // заполнен, а on_ready не вызывается
+    bool Enqueue(std::unique_ptr<Request> request, QueryPriority priority, OverflowAction overflow_action);
+
+    void RunWorker();
+
+    std::future<std::vector<Document>> SubmitSearch(SearchFunction search, QueryPriority priority, QueryDeadline deadline,
+        OverflowAction overflow_action);
+
+    template <typename DocumentPredicate>
+    static SearchFunction MakeSearch(std::string raw_query, DocumentPredicate document_predicate);
+
+    static void Reject(Request& request, const char* reason);
+};
+
+#ifdef ASYNC_SEARCH_SERVER_COROUTINES
+class AsyncSearchServer::SearchAwaiter {
+public:
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle);
+
+    std::vector<Document> await_resume() {
+        return result_.get();
+    }
+
+private:
+    friend class AsyncSearchServer;
+
+    SearchAwaiter(AsyncSearchServer& server, SearchFunction search, QueryPriority priority, QueryDeadline deadline);
+
+    AsyncSearchServer& server_;
+    SearchFunction search_;
+    QueryPriority priority_;
+    QueryDeadline deadline_;
+    std::future<std::vector<Document>> result_;
+};
+#endif
+
+template <typename DocumentPredicate>
+std::future<std::vector<Document>> AsyncSearchServer::Submit(std::string raw_query, DocumentPredicate document_predicate,
+    QueryPriority priority, QueryDeadline deadline) {
+    return SubmitSearch(MakeSearch(std::move(raw_query), std::move(document_predicate)), priority, deadline,
+        OverflowAction::SHED);
+}
+
+template <typename DocumentPredicate>
+std::future<std::vector<Document>> AsyncSearchServer::SubmitWait(std::string raw_query, DocumentPredicate document_predicate,
+    QueryPriority priority, QueryDeadline deadline) {
+    return SubmitSearch(MakeSearch(std::move(raw_query), std::move(document_predicate)), priority, deadline,
+        OverflowAction::WAIT);
+}
+
+#ifdef ASYNC_SEARCH_SERVER_COROUTINES
+template <typename DocumentPredicate>
+AsyncSearchServer::SearchAwaiter AsyncSearchServer::Search(std::string raw_query, DocumentPredicate document_predicate,
+    QueryPriority priority, QueryDeadline deadline) {
+    return SearchAwaiter(*this, MakeSearch(std::move(raw_query), std::move(document_predicate)), priority, deadline);
+}
+#endif
+
+// Статус выбирает перегрузку FindTopDocumentsWithDeadline с фильтром по
+// статусу, любой другой тип - перегрузку с предикатом
+template <typename DocumentPredicate>
+AsyncSearchServer::SearchFunction AsyncSearchServer::MakeSearch(std::string raw_query, DocumentPredicate document_predicate) {
+    return [raw_query = std::move(raw_query), document_predicate = std::move(document_predicate)](
+        const SearchServer& search_server, const QueryDeadline& deadline) {
+        return search_server.FindTopDocumentsWithDeadline(deadline, raw_query, document_predicate);
+    };
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Массив, разбитый на куски по ChunkSize значений, которые разделяются между
+// копиями массива. Копирование стоит O(числа кусков) и не трогает значения,
+// а кусок, который видит ещё какая-то копия, перед записью дублируется.
+// Поэтому опубликованную копию можно читать из других потоков, пока
+// единственный писатель меняет свою. Незаписанные значения равны Value{}.
+template <typename Value, size_t ChunkSize = 1024>
+class ChunkedArray {
+public:
+    Value Get(size_t index) const;
+
+    void Set(size_t index, Value value);
+
+private:
+    using Chunk = std::array<Value, ChunkSize>;
+
+    std::vector<std::shared_ptr<Chunk>> chunks_;
+};
+
+template <typename Value, size_t ChunkSize>
+Value ChunkedArray<Value, ChunkSize>::Get(size_t index) const {
+    const size_t chunk_index = index / ChunkSize;
+    if (chunk_index >= chunks_.size() || !chunks_[chunk_index]) {
+        return Value{};
+    }
+    return (*chunks_[chunk_index])[index % ChunkSize];
+}
+
+template <typename Value, size_t ChunkSize>
+void ChunkedArray<Value, ChunkSize>::Set(size_t index, Value value) {
+    const size_t chunk_index = index / ChunkSize;
+    if (chunk_index >= chunks_.size()) {
+        chunks_.resize(chunk_index + 1);
+    }
+
+    std::shared_ptr<Chunk>& chunk = chunks_[chunk_index];
+    if (!chunk) {
+        chunk = std::make_shared<Chunk>();
+    }
+    else if (chunk.use_count() > 1) {
+        chunk = std::make_shared<Chunk>(*chunk);
+    }
+    else {
+        // Последняя чужая ссылка могла быть только что отпущена читателем
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    (*chunk)[index % ChunkSize] = value;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Хеш-таблица, разбитая на куски, которые разделяются между копиями таблицы,
+// как в ChunkedArray: копирование стоит O(числа кусков), а кусок, который
+// видит ещё какая-то копия, перед записью дублируется. Число кусков
+// удваивается, когда средний кусок становится длиннее их числа, поэтому и
+// кусков, и ключей в куске около корня из размера таблицы. Ключи в куске
+// упорядочены.
+template <typename Key, typename Value>
+class ChunkedHashMap {
+public:
+    std::optional<Value> Find(const Key& key) const;
+
+    // Вставляет ключ или меняет его значение
+    void Set(const Key& key, Value value);
+
+    bool Erase(const Key& key);
+
+    size_t size() const;
+
+private:
+    using Chunk = std::vector<std::pair<Key, Value>>;
+
+    std::vector<std::shared_ptr<Chunk>> chunks_;
+    size_t size_ = 0;
+
+    size_t GetChunkIndex(const Key& key) const;
+
+    Chunk& GetMutableChunk(size_t chunk_index);
+
+    void Grow();
+
+    static typename Chunk::const_iterator LowerBound(const Chunk& chunk, const Key& key);
+};
+
+template <typename Key, typename Value>
+std::optional<Value> ChunkedHashMap<Key, Value>::Find(const Key& key) const {
+    if (chunks_.empty()) {
+        return std::nullopt;
+    }
+    const std::shared_ptr<Chunk>& chunk = chunks_[GetChunkIndex(key)];
+    if (!chunk) {
+        return std::nullopt;
+    }
+    const auto it = LowerBound(*chunk, key);
+    if (it == chunk->end() || it->first != key) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+template <typename Key, typename Value>
+void ChunkedHashMap<Key, Value>::Set(const Key& key, Value value) {
+    if (size_ + 1 > chunks_.size() * chunks_.size()) {
+        Grow();
+    }
+    Chunk& chunk = GetMutableChunk(GetChunkIndex(key));
+    const auto position = LowerBound(chunk, key) - chunk.begin();
+    if (position < static_cast<std::ptrdiff_t>(chunk.size()) && chunk[position].first == key) {
+        chunk[position].second = std::move(value);
+        return;
+    }
+    chunk.emplace(chunk.begin() + position, key, std::move(value));
+    ++size_;
+}
+
+template <typename Key, typename Value>
+bool ChunkedHashMap<Key, Value>::Erase(const Key& key) {
+    if (!Find(key)) {
+        return false;
+    }
+    Chunk& chunk = GetMutableChunk(GetChunkIndex(key));
+    chunk.erase(chunk.begin() + (LowerBound(chunk, key) - chunk.begin()));
+    --size_;
+    return true;
+}
+
+template <typename Key, typename Value>
+size_t ChunkedHashMap<Key, Value>::size() const {
+    return size_;
+}
+
+template <typename Key, typename Value>
+size_t ChunkedHashMap<Key, Value>::GetChunkIndex(const Key& key) const {
+    const uint64_t hash = static_cast<uint64_t>(std::hash<Key>{}(key)) * 0x9E3779B97F4A7C15ull;
+    return (hash >> 32) & (chunks_.size() - 1);
+}
+
+template <typename Key, typename Value>
+typename ChunkedHashMap<Key, Value>::Chunk& ChunkedHashMap<Key, Value>::GetMutableChunk(size_t chunk_index) {
+    std::shared_ptr<Chunk>& chunk = chunks_[chunk_index];
+    if (!chunk) {
+        chunk = std::make_shared<Chunk>();
+    }
+    else if (chunk.use_count() > 1) {
+        chunk = std::make_shared<Chunk>(*chunk);
+    }
+    else {
+        // Последняя чужая ссылка могла быть только что отпущена читателем
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *chunk;
+}
+
+// Куски собираются заново, прежние остаются копиям, которые их видят.
+// Номер куска берётся из младших битов хеша, поэтому ключи старого куска
+// расходятся по двум новым, не нарушая порядка.
+template <typename Key, typename Value>
+void ChunkedHashMap<Key, Value>::Grow() {
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    chunks.swap(chunks_);
+    chunks_.resize(chunks.empty() ? 1 : chunks.size() * 2);
+    for (const std::shared_ptr<Chunk>& chunk : chunks) {
+        if (!chunk) {
+            continue;
+        }
+        for (const auto& [key, value] : *chunk) {
+            std::shared_ptr<Chunk>& target = chunks_[GetChunkIndex(key)];
+            if (!target) {
+                target = std::make_shared<Chunk>();
+            }
+            target->emplace_back(key, value);
+        }
+    }
+}
+
+template <typename Key, typename Value>
+typename ChunkedHashMap<Key, Value>::Chunk::const_iterator ChunkedHashMap<Key, Value>::LowerBound(const Chunk& chunk, const Key& key) {
+    return std::lower_bound(chunk.begin(), chunk.end(), key, [](const std::pair<Key, Value>& item, const Key& key) {
+        return item.first < key;
+        });
+}
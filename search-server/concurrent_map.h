@@ -1,60 +1,236 @@
-#pragma once
-
-#include <mutex>
-#include <map>
-#include <vector>
-
-using namespace std::string_literals;
-
-template <typename Key, typename Value>
-class ConcurrentMap {
-private:
-    struct Bucket;
-
-public:
-    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
-
-    struct Access {
-        std::lock_guard <std::mutex> guard;
-        Value& ref_to_value;
-
-        Access(const Key& key, Bucket& bucket)
-            : guard(bucket.mutex),
-            ref_to_value(bucket.map[key])
-        {
-        }
-    };
-
-    explicit ConcurrentMap(size_t bucket_count)
-        : buckets_(bucket_count)
-    {
-    }
-
-    Access operator[](const Key& key) {
-        auto& bucket = buckets_[key % buckets_.size()];
-        return { key, bucket };
-    }
-
-    std::map<Key, Value> BuildOrdinaryMap() {
-        std::map<Key, Value> result;
-        for (auto& [mutex, map] : buckets_) {
-            std::lock_guard guard(mutex);
-            result.insert(map.begin(), map.end());
-        }
-        return result;
-    }
-
-    auto Erase(const Key& key) {
-        uint64_t tmp_key = static_cast<uint64_t>(key) % buckets_.size();
-        std::lock_guard guard(buckets_[tmp_key].mutex);
-        return buckets_[tmp_key].map.erase(key);
-    }
-
-private:
-    struct Bucket {
-        std::mutex mutex;
-        std::map<Key, Value> map;
-    };
-
-    std::vector<Bucket> buckets_;
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std::string_literals;
+
+// Словарь с целыми ключами для одновременной записи из многих потоков.
+// Ключи разбиты по корзинам, у каждой корзины свой мьютекс: потоки, которые
+// пишут в разные корзины, не мешают друг другу, а в одну — ждут друг друга,
+// так что словарь блокирующий, а не lock-free. Access держит блокировку
+// корзины, пока жив. ForEach, BuildOrdinaryVector и BuildOrdinaryMap берут
+// блокировки корзин по одной, поэтому при одновременной записи каждая
+// корзина видна целиком, но весь словарь — не на один момент времени.
+template <typename Key, typename Value>
+class ConcurrentMap {
+private:
+    struct Bucket;
+
+public:
+    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
+
+    struct Access {
+        std::lock_guard <std::mutex> guard;
+        Value& ref_to_value;
+
+        Access(const Key& key, Bucket& bucket)
+            : guard(bucket.mutex),
+            ref_to_value(bucket.table.FindOrInsert(key))
+        {
+        }
+    };
+
+    // Число корзин выбирается по числу аппаратных потоков с запасом,
+    // чтобы потоки редко конкурировали за одну корзину.
+    ConcurrentMap()
+        : ConcurrentMap(std::max(1u, std::thread::hardware_concurrency()) * BUCKETS_PER_THREAD)
+    {
+    }
+
+    explicit ConcurrentMap(size_t bucket_count)
+        : buckets_(std::max<size_t>(bucket_count, 1))
+    {
+    }
+
+    Access operator[](const Key& key) {
+        return { key, GetBucket(key) };
+    }
+
+    auto Erase(const Key& key) {
+        Bucket& bucket = GetBucket(key);
+        std::lock_guard guard(bucket.mutex);
+        return bucket.table.Erase(key);
+    }
+
+    // Обходит все элементы; корзины обрабатываются параллельно, каждая под своей блокировкой.
+    template <typename ExecutionPolicy, typename Function>
+    void ForEach(ExecutionPolicy&& policy, Function function) {
+        std::for_each(policy, buckets_.begin(), buckets_.end(), [&function](Bucket& bucket) {
+            std::lock_guard guard(bucket.mutex);
+            bucket.table.ForEach(function);
+            });
+    }
+
+    template <typename ExecutionPolicy>
+    std::vector<std::pair<Key, Value>> BuildOrdinaryVector(ExecutionPolicy&& policy) {
+        std::vector<std::pair<Key, Value>> result;
+        for (auto& items : CollectBuckets(policy)) {
+            result.insert(result.end(), std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+        }
+        std::sort(policy, result.begin(), result.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first < rhs.first;
+            });
+        return result;
+    }
+
+    std::map<Key, Value> BuildOrdinaryMap() {
+        std::map<Key, Value> result;
+        for (auto& items : CollectBuckets(std::execution::par)) {
+            result.insert(std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+        }
+        return result;
+    }
+
+private:
+    static constexpr size_t BUCKETS_PER_THREAD = 8;
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // Хеш-таблица с открытой адресацией и линейным пробированием.
+    // Удалённые ячейки помечаются и переиспользуются при вставке.
+    class FlatTable {
+    public:
+        Value& FindOrInsert(const Key& key) {
+            if ((used_ + 1) * 4 > slots_.size() * 3) {
+                const size_t capacity = size_ * 2 > slots_.size() ? slots_.size() * 2 : slots_.size();
+                Rehash(std::max(capacity, MIN_CAPACITY));
+            }
+
+            const size_t mask = slots_.size() - 1;
+            size_t free_index = slots_.size();
+            for (size_t index = Hash(key) & mask;; index = (index + 1) & mask) {
+                Slot& slot = slots_[index];
+                if (slot.state == SlotState::FULL && slot.key == key) {
+                    return slot.value;
+                }
+                if (slot.state == SlotState::DELETED && free_index == slots_.size()) {
+                    free_index = index;
+                }
+                if (slot.state == SlotState::EMPTY) {
+                    if (free_index == slots_.size()) {
+                        free_index = index;
+                        ++used_;
+                    }
+                    break;
+                }
+            }
+
+            Slot& slot = slots_[free_index];
+            slot.key = key;
+            slot.value = Value();
+            slot.state = SlotState::FULL;
+            ++size_;
+            return slot.value;
+        }
+
+        size_t Erase(const Key& key) {
+            if (slots_.empty()) {
+                return 0;
+            }
+            const size_t mask = slots_.size() - 1;
+            for (size_t index = Hash(key) & mask;; index = (index + 1) & mask) {
+                Slot& slot = slots_[index];
+                if (slot.state == SlotState::EMPTY) {
+                    return 0;
+                }
+                if (slot.state == SlotState::FULL && slot.key == key) {
+                    slot.state = SlotState::DELETED;
+                    --size_;
+                    return 1;
+                }
+            }
+        }
+
+        template <typename Function>
+        void ForEach(Function&& function) {
+            for (Slot& slot : slots_) {
+                if (slot.state == SlotState::FULL) {
+                    function(slot.key, slot.value);
+                }
+            }
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+    private:
+        static constexpr size_t MIN_CAPACITY = 16;
+
+        enum class SlotState : uint8_t {
+            EMPTY,
+            FULL,
+            DELETED
+        };
+
+        struct Slot {
+            Key key{};
+            Value value{};
+            SlotState state = SlotState::EMPTY;
+        };
+
+        std::vector<Slot> slots_;
+        size_t size_ = 0;
+        size_t used_ = 0;
+
+        void Rehash(size_t capacity) {
+            std::vector<Slot> old_slots(capacity);
+            old_slots.swap(slots_);
+            size_ = 0;
+            used_ = 0;
+            for (Slot& slot : old_slots) {
+                if (slot.state == SlotState::FULL) {
+                    FindOrInsert(slot.key) = std::move(slot.value);
+                }
+            }
+        }
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Bucket {
+        std::mutex mutex;
+        FlatTable table;
+    };
+
+    std::vector<Bucket> buckets_;
+
+    // Перемешивает биты ключа, чтобы и отрицательные, и последовательные
+    // ключи равномерно распределялись по корзинам и ячейкам.
+    static uint64_t Hash(const Key& key) {
+        uint64_t hash = static_cast<uint64_t>(key);
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    Bucket& GetBucket(const Key& key) {
+        return buckets_[(Hash(key) >> 32) % buckets_.size()];
+    }
+
+    template <typename ExecutionPolicy>
+    std::vector<std::vector<std::pair<Key, Value>>> CollectBuckets(ExecutionPolicy&& policy) {
+        std::vector<std::vector<std::pair<Key, Value>>> result(buckets_.size());
+        std::vector<size_t> indexes(buckets_.size());
+        std::iota(indexes.begin(), indexes.end(), 0);
+        std::for_each(policy, indexes.begin(), indexes.end(), [this, &result](size_t index) {
+            Bucket& bucket = buckets_[index];
+            std::lock_guard guard(bucket.mutex);
+            auto& items = result[index];
+            items.reserve(bucket.table.size());
+            bucket.table.ForEach([&items](const Key& key, const Value& value) {
+                items.emplace_back(key, value);
+                });
+            });
+        return result;
+    }
 };
\ No newline at end of file
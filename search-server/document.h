@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct Document {
@@ -23,4 +24,12 @@ enum class DocumentStatus {
     REMOVED
 };
 
+// Документ для пакетного добавления; текст должен жить до конца вызова AddDocuments
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
 std::ostream& operator<<(std::ostream& out, const Document& document);
\ No newline at end of file
@@ -0,0 +1,255 @@
+#include "head_segment.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+const size_t INITIAL_POSTING_BUFFER_SIZE = 4;
+
+size_t GetTableSize(size_t max_item_count) {
+    size_t size = 1;
+    while (size < 2 * max_item_count) {
+        size *= 2;
+    }
+    return size;
+}
+
+}  // namespace
+
+HeadSegment::PostingBuffer::PostingBuffer(size_t capacity)
+    : ordinals(capacity)
+    , term_counts(capacity)
+    , document_lengths(capacity)
+    , max_term_freqs(capacity)
+{
+}
+
+HeadSegment::HeadSegment(DocumentOrdinal first_ordinal, size_t max_document_count, size_t max_posting_count, size_t max_text_size)
+    : first_ordinal_(first_ordinal)
+    , max_document_count_(max_document_count)
+    , max_posting_count_(max_posting_count)
+    , term_table_(GetTableSize(max_posting_count))
+    , id_table_(GetTableSize(max_document_count))
+{
+    document_ids_.reserve(max_document_count);
+    ratings_.reserve(max_document_count);
+    statuses_.reserve(max_document_count);
+    texts_.reserve(max_text_size);
+    text_offsets_.reserve(max_document_count + 1);
+    text_offsets_.push_back(0);
+    word_freqs_.reserve(max_posting_count);
+    word_freq_offsets_.reserve(max_document_count + 1);
+    word_freq_offsets_.push_back(0);
+    previous_same_ids_.reserve(max_document_count);
+}
+
+bool HeadSegment::CanAdd(size_t text_size, size_t term_count) const {
+    return document_ids_.size() < max_document_count_
+        && text_size <= texts_.capacity() - texts_.size()
+        && term_count <= max_posting_count_ - word_freqs_.size();
+}
+
+// Новые данные пишутся за концом того, что видят снимки, а размер массива
+// вхождений публикуется после записи самих вхождений
+void HeadSegment::AddDocument(int document_id, int rating, DocumentStatus status, std::string_view text,
+    const std::vector<std::pair<TermId, uint32_t>>& term_counts, uint32_t document_length) {
+    if (!CanAdd(text.size(), term_counts.size())) {
+        throw std::logic_error("Головной сегмент заполнен");
+    }
+
+    const DocumentOrdinal ordinal = first_ordinal_ + static_cast<DocumentOrdinal>(document_ids_.size());
+    size_t id_slot = GetIdSlot(document_id);
+    uint32_t previous_same_id = 0;
+    while (const uint32_t entry = id_table_[id_slot].load(std::memory_order_relaxed)) {
+        if (document_ids_[entry - 1] == document_id) {
+            previous_same_id = entry;
+            break;
+        }
+        id_slot = (id_slot + 1) & (id_table_.size() - 1);
+    }
+    previous_same_ids_.push_back(previous_same_id);
+    document_ids_.push_back(document_id);
+    id_table_[id_slot].store(static_cast<uint32_t>(document_ids_.size()), std::memory_order_release);
+    ratings_.push_back(rating);
+    statuses_.push_back(status);
+    const auto status_index = static_cast<size_t>(status);
+    if (status_index < STATUS_COUNT) {
+        ++status_counts_[status_index];
+    }
+    texts_.insert(texts_.end(), text.begin(), text.end());
+    text_offsets_.push_back(texts_.size());
+
+    for (const auto& [term_id, term_count] : term_counts) {
+        const double term_freq = ComputeTermFreq(term_count, document_length);
+        word_freqs_.emplace_back(term_id, term_freq);
+
+        TermPostings& term = FindOrAddTerm(term_id);
+        PostingBuffer* buffer = term.buffers.back().get();
+        const size_t size = buffer->size.load(std::memory_order_relaxed);
+        if (size == buffer->ordinals.size()) {
+            auto grown = std::make_unique<PostingBuffer>(size * 2);
+            std::copy_n(buffer->ordinals.begin(), size, grown->ordinals.begin());
+            std::copy_n(buffer->term_counts.begin(), size, grown->term_counts.begin());
+            std::copy_n(buffer->document_lengths.begin(), size, grown->document_lengths.begin());
+            std::copy_n(buffer->max_term_freqs.begin(), size, grown->max_term_freqs.begin());
+            grown->size.store(size, std::memory_order_relaxed);
+            buffer = grown.get();
+            term.buffers.push_back(std::move(grown));
+            term.buffer.store(buffer, std::memory_order_release);
+        }
+        buffer->ordinals[size] = ordinal;
+        buffer->term_counts[size] = term_count;
+        buffer->document_lengths[size] = document_length;
+        buffer->max_term_freqs[size] = size == 0 ? term_freq : std::max(buffer->max_term_freqs[size - 1], term_freq);
+        buffer->size.store(size + 1, std::memory_order_release);
+    }
+    word_freq_offsets_.push_back(word_freqs_.size());
+}
+
+DocumentOrdinal HeadSegment::GetFirstOrdinal() const {
+    return first_ordinal_;
+}
+
+size_t HeadSegment::GetDocumentCount() const {
+    return document_ids_.size();
+}
+
+size_t HeadSegment::GetPostingCount() const {
+    return word_freqs_.size();
+}
+
+size_t HeadSegment::GetStatusCount(DocumentStatus status) const {
+    const auto status_index = static_cast<size_t>(status);
+    if (status_index >= STATUS_COUNT) {
+        return static_cast<size_t>(std::count(statuses_.begin(), statuses_.end(), status));
+    }
+    return status_counts_[status_index];
+}
+
+ArrayView<int> HeadSegment::GetDocumentIds() const {
+    return ArrayView(document_ids_);
+}
+
+ArrayView<int> HeadSegment::GetRatings() const {
+    return ArrayView(ratings_);
+}
+
+ArrayView<DocumentStatus> HeadSegment::GetStatuses() const {
+    return ArrayView(statuses_);
+}
+
+ArrayView<char> HeadSegment::GetTexts() const {
+    return ArrayView(texts_);
+}
+
+ArrayView<size_t> HeadSegment::GetTextOffsets() const {
+    return ArrayView(text_offsets_);
+}
+
+ArrayView<WordFreq> HeadSegment::GetWordFreqs() const {
+    return ArrayView(word_freqs_);
+}
+
+ArrayView<size_t> HeadSegment::GetWordFreqOffsets() const {
+    return ArrayView(word_freq_offsets_);
+}
+
+PostingListView HeadSegment::FindPostings(TermId term_id, DocumentOrdinal end_ordinal) const {
+    const TermPostings* term = FindTerm(term_id);
+    if (term == nullptr) {
+        return {};
+    }
+    return MakeView(*term->buffer.load(std::memory_order_acquire), end_ordinal);
+}
+
+// Если документ с этим id удалили и добавили снова, возвращается более новый
+// из видимых в снимке: ячейка хранит последний, а от него идёт цепочка
+// предыдущих с тем же id
+std::optional<DocumentOrdinal> HeadSegment::FindDocument(int document_id, DocumentOrdinal end_ordinal) const {
+    const size_t document_count = end_ordinal - first_ordinal_;
+    const int* document_ids = document_ids_.data();
+    for (size_t slot = GetIdSlot(document_id);; slot = (slot + 1) & (id_table_.size() - 1)) {
+        uint32_t entry = id_table_[slot].load(std::memory_order_acquire);
+        if (entry == 0) {
+            return std::nullopt;
+        }
+        if (document_ids[entry - 1] != document_id) {
+            continue;
+        }
+        while (entry > document_count) {
+            entry = previous_same_ids_.data()[entry - 1];
+        }
+        if (entry == 0) {
+            return std::nullopt;
+        }
+        return first_ordinal_ + static_cast<DocumentOrdinal>(entry - 1);
+    }
+}
+
+std::vector<std::pair<TermId, PostingListView>> HeadSegment::GetTerms(DocumentOrdinal end_ordinal) const {
+    std::vector<std::pair<TermId, PostingListView>> terms;
+    for (const auto& slot : term_table_) {
+        const TermPostings* term = slot.load(std::memory_order_acquire);
+        if (term == nullptr) {
+            continue;
+        }
+        const PostingListView postings = MakeView(*term->buffer.load(std::memory_order_acquire), end_ordinal);
+        if (!postings.empty()) {
+            terms.emplace_back(term->term_id, postings);
+        }
+    }
+    std::sort(terms.begin(), terms.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first;
+        });
+    return terms;
+}
+
+HeadSegment::TermPostings& HeadSegment::FindOrAddTerm(TermId term_id) {
+    size_t slot = GetTermSlot(term_id);
+    while (TermPostings* term = term_table_[slot].load(std::memory_order_relaxed)) {
+        if (term->term_id == term_id) {
+            return *term;
+        }
+        slot = (slot + 1) & (term_table_.size() - 1);
+    }
+
+    auto term = std::make_unique<TermPostings>();
+    term->term_id = term_id;
+    term->buffers.push_back(std::make_unique<PostingBuffer>(INITIAL_POSTING_BUFFER_SIZE));
+    term->buffer.store(term->buffers.back().get(), std::memory_order_relaxed);
+    term_table_[slot].store(term.get(), std::memory_order_release);
+    terms_.push_back(std::move(term));
+    return *terms_.back();
+}
+
+const HeadSegment::TermPostings* HeadSegment::FindTerm(TermId term_id) const {
+    size_t slot = GetTermSlot(term_id);
+    while (const TermPostings* term = term_table_[slot].load(std::memory_order_acquire)) {
+        if (term->term_id == term_id) {
+            return term;
+        }
+        slot = (slot + 1) & (term_table_.size() - 1);
+    }
+    return nullptr;
+}
+
+size_t HeadSegment::GetTermSlot(TermId term_id) const {
+    return (static_cast<size_t>(term_id) * 0x9E3779B97F4A7C15ull >> 20) & (term_table_.size() - 1);
+}
+
+size_t HeadSegment::GetIdSlot(int document_id) const {
+    return (static_cast<size_t>(static_cast<uint32_t>(document_id)) * 0x9E3779B97F4A7C15ull >> 20) & (id_table_.size() - 1);
+}
+
+// Вхождения, дописанные после снимка, отсекаются по номеру документа
+PostingListView HeadSegment::MakeView(const PostingBuffer& buffer, DocumentOrdinal end_ordinal) {
+    const size_t size = buffer.size.load(std::memory_order_acquire);
+    const DocumentOrdinal* ordinals = buffer.ordinals.data();
+    const size_t count = std::lower_bound(ordinals, ordinals + size, end_ordinal) - ordinals;
+    if (count == 0) {
+        return {};
+    }
+    return PostingListView(ordinals, buffer.term_counts.data(), buffer.document_lengths.data(),
+        count, buffer.max_term_freqs[count - 1]);
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "document.h"
+#include "index_segment.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+#include "array_view.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Головной сегмент индекса: новые документы дописываются в него по одному,
+// пока он не заполнится, а затем он запечатывается в IndexSegment. Писатель
+// у головы один. Читатели получают её через снимки, IndexSegment(head), и
+// видят только документы до конца снимка. Столбцы документов выделяются
+// сразу на всю ёмкость, а массив вхождений слова при росте копируется в
+// новый, прежний же живёт до конца головы, поэтому дописывание не сдвигает
+// то, что уже читают.
+class HeadSegment {
+public:
+    HeadSegment(DocumentOrdinal first_ordinal, size_t max_document_count, size_t max_posting_count, size_t max_text_size);
+
+    HeadSegment(const HeadSegment&) = delete;
+    HeadSegment& operator=(const HeadSegment&) = delete;
+
+    // Поместится ли ещё документ с таким текстом и числом различных слов
+    bool CanAdd(size_t text_size, size_t term_count) const;
+
+    // term_counts — слова документа по возрастанию TermId с числом вхождений
+    void AddDocument(int document_id, int rating, DocumentStatus status, std::string_view text,
+        const std::vector<std::pair<TermId, uint32_t>>& term_counts, uint32_t document_length);
+
+    // Состояние головы на момент вызова; вызываются только писателем
+    DocumentOrdinal GetFirstOrdinal() const;
+
+    size_t GetDocumentCount() const;
+
+    size_t GetPostingCount() const;
+
+    size_t GetStatusCount(DocumentStatus status) const;
+
+    ArrayView<int> GetDocumentIds() const;
+
+    ArrayView<int> GetRatings() const;
+
+    ArrayView<DocumentStatus> GetStatuses() const;
+
+    ArrayView<char> GetTexts() const;
+
+    ArrayView<size_t> GetTextOffsets() const;
+
+    ArrayView<WordFreq> GetWordFreqs() const;
+
+    ArrayView<size_t> GetWordFreqOffsets() const;
+
+    // Чтение снимка с концом end_ordinal; можно вызывать из любых потоков
+    // одновременно с дописыванием
+    PostingListView FindPostings(TermId term_id, DocumentOrdinal end_ordinal) const;
+
+    std::optional<DocumentOrdinal> FindDocument(int document_id, DocumentOrdinal end_ordinal) const;
+
+    // Непустые списки вхождений снимка по возрастанию TermId
+    std::vector<std::pair<TermId, PostingListView>> GetTerms(DocumentOrdinal end_ordinal) const;
+
+private:
+    struct PostingBuffer {
+        explicit PostingBuffer(size_t capacity);
+
+        std::vector<DocumentOrdinal> ordinals;
+        std::vector<uint32_t> term_counts;
+        std::vector<uint32_t> document_lengths;
+        // Наибольшая частота слова среди вхождений от первого до данного
+        std::vector<double> max_term_freqs;
+        std::atomic<size_t> size{ 0 };
+    };
+
+    struct TermPostings {
+        TermId term_id = 0;
+        std::atomic<const PostingBuffer*> buffer{ nullptr };
+        // Текущий массив последний; прежние могут ещё читаться
+        std::vector<std::unique_ptr<PostingBuffer>> buffers;
+    };
+
+    static constexpr size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+    DocumentOrdinal first_ordinal_;
+    size_t max_document_count_;
+    size_t max_posting_count_;
+
+    std::vector<int> document_ids_;
+    std::vector<int> ratings_;
+    std::vector<DocumentStatus> statuses_;
+    std::vector<char> texts_;
+    std::vector<size_t> text_offsets_;
+    std::vector<WordFreq> word_freqs_;
+    std::vector<size_t> word_freq_offsets_;
+    // Номер в голове плюс один предыдущего документа с тем же id или ноль
+    std::vector<uint32_t> previous_same_ids_;
+    std::array<size_t, STATUS_COUNT> status_counts_{};
+
+    // Открытая адресация по TermId; слов не больше max_posting_count_, а
+    // ячеек вдвое больше, поэтому поиск всегда доходит до пустой ячейки
+    std::vector<std::atomic<TermPostings*>> term_table_;
+    std::vector<std::unique_ptr<TermPostings>> terms_;
+    // Так же по id документа: номер в голове плюс один последнего документа
+    // с этим id, ноль в пустой ячейке
+    std::vector<std::atomic<uint32_t>> id_table_;
+
+    TermPostings& FindOrAddTerm(TermId term_id);
+
+    const TermPostings* FindTerm(TermId term_id) const;
+
+    size_t GetTermSlot(TermId term_id) const;
+
+    size_t GetIdSlot(int document_id) const;
+
+    static PostingListView MakeView(const PostingBuffer& buffer, DocumentOrdinal end_ordinal);
+};
@@ -0,0 +1,171 @@
+#include "index_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char INDEX_FILE_MAGIC[8] = { 'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0' };
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr size_t SECTION_ALIGNMENT = 8;
+
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+};
+
+}  // namespace
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        file_ = nullptr;
+        throw std::runtime_error("Не удалось открыть файл " + path);
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size)) {
+        CloseHandle(file_);
+        throw std::runtime_error("Не удалось отобразить файл " + path);
+    }
+    // Пустой файл отобразить нельзя, он представляется пустым диапазоном
+    if (size.QuadPart == 0) {
+        return;
+    }
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr) {
+        if (mapping_) {
+            CloseHandle(mapping_);
+        }
+        CloseHandle(file_);
+        throw std::runtime_error("Не удалось отобразить файл " + path);
+    }
+    data_ = static_cast<const char*>(view);
+    size_ = static_cast<size_t>(size.QuadPart);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+        CloseHandle(mapping_);
+    }
+    CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw std::runtime_error("Не удалось открыть файл " + path);
+    }
+    struct stat status;
+    void* view = MAP_FAILED;
+    if (fstat(descriptor, &status) == 0) {
+        // Пустой файл отобразить нельзя, он представляется пустым диапазоном
+        if (status.st_size == 0) {
+            close(descriptor);
+            return;
+        }
+        view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+    }
+    // Отображение остаётся действительным и после закрытия дескриптора
+    close(descriptor);
+    if (view == MAP_FAILED) {
+        throw std::runtime_error("Не удалось отобразить файл " + path);
+    }
+    data_ = static_cast<const char*>(view);
+    size_ = static_cast<size_t>(status.st_size);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+#endif
+
+const char* MappedFile::data() const {
+    return data_;
+}
+
+size_t MappedFile::size() const {
+    return size_;
+}
+
+IndexFileWriter::IndexFileWriter(std::ostream& output)
+    : output_(output)
+{
+    IndexFileHeader header{};
+    std::memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+    header.version = INDEX_FILE_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    Write(&header, sizeof(header));
+    EndSection();
+}
+
+void IndexFileWriter::WriteValue(uint64_t value) {
+    Write(&value, sizeof(value));
+    EndSection();
+}
+
+void IndexFileWriter::Write(const void* data, size_t size) {
+    output_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    offset_ += size;
+    if (!output_) {
+        throw std::runtime_error("Не удалось записать файл индекса");
+    }
+}
+
+void IndexFileWriter::EndSection() {
+    static const char padding[SECTION_ALIGNMENT] = {};
+    Write(padding, (SECTION_ALIGNMENT - offset_ % SECTION_ALIGNMENT) % SECTION_ALIGNMENT);
+}
+
+IndexFileReader::IndexFileReader(std::shared_ptr<const MappedFile> file)
+    : file_(std::move(file))
+{
+    IndexFileHeader header;
+    std::memcpy(&header, Take(sizeof(header)), sizeof(header));
+    if (std::memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Файл не является файлом индекса");
+    }
+    if (header.version != INDEX_FILE_VERSION || header.byte_order != BYTE_ORDER_MARK) {
+        throw std::runtime_error("Несовместимый формат файла индекса");
+    }
+}
+
+uint64_t IndexFileReader::ReadValue() {
+    uint64_t value;
+    std::memcpy(&value, Take(sizeof(value)), sizeof(value));
+    return value;
+}
+
+const std::shared_ptr<const MappedFile>& IndexFileReader::GetFile() const {
+    return file_;
+}
+
+const char* IndexFileReader::Take(size_t size) {
+    if (size > file_->size() - offset_) {
+        throw std::runtime_error("Файл индекса повреждён");
+    }
+    const char* data = file_->data() + offset_;
+    offset_ += size;
+    offset_ = std::min(file_->size(), (offset_ + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT);
+    return data;
+}
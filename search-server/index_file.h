@@ -0,0 +1,146 @@
+#pragma once
+
+#include "array_view.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* data() const;
+
+    size_t size() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+inline constexpr uint32_t INDEX_FILE_VERSION = 1;
+
+// Файл индекса — заголовок и следующие за ним разделы. Раздел — это либо
+// одно число, либо массив: число элементов, размер элемента и сами элементы,
+// выровненные по 8 байт, так что при чтении массив используется прямо из
+// отображённых страниц. Элементы пишутся в представлении машины, поэтому
+// заголовок хранит порядок байт, а каждый массив — размер своего элемента:
+// файл с другой раскладкой данных не откроется.
+class IndexFileWriter {
+public:
+    explicit IndexFileWriter(std::ostream& output);
+
+    void WriteValue(uint64_t value);
+
+    // Массив чисел или перечислений пишется как есть
+    template <typename Value>
+    void WriteArray(const Value* data, size_t count);
+
+    template <typename Value>
+    void WriteArray(ArrayView<Value> values);
+
+    // Массив структур пишется по полям: write_fields(value, record) кладёт
+    // поля value в обнулённый образ элемента через WriteIndexField, поэтому
+    // байты выравнивания в файле всегда нулевые
+    template <typename Value, typename WriteFields>
+    void WriteArray(ArrayView<Value> values, WriteFields write_fields);
+
+private:
+    static constexpr size_t RECORD_BUFFER_SIZE = 64 * 1024;
+
+    std::ostream& output_;
+    size_t offset_ = 0;
+
+    void Write(const void* data, size_t size);
+
+    // Дополняет раздел нулями до границы выравнивания
+    void EndSection();
+};
+
+// Копирует поле в образ элемента по его смещению offsetof
+template <typename Field>
+void WriteIndexField(char* record, size_t offset, const Field& field) {
+    static_assert(std::is_arithmetic_v<Field> || std::is_enum_v<Field>, "Поле пишется как число");
+    std::memcpy(record + offset, &field, sizeof(Field));
+}
+
+class IndexFileReader {
+public:
+    explicit IndexFileReader(std::shared_ptr<const MappedFile> file);
+
+    uint64_t ReadValue();
+
+    template <typename Value>
+    ArrayView<Value> ReadArray();
+
+    const std::shared_ptr<const MappedFile>& GetFile() const;
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    size_t offset_ = 0;
+
+    const char* Take(size_t size);
+};
+
+template <typename Value>
+void IndexFileWriter::WriteArray(const Value* data, size_t count) {
+    static_assert(std::is_arithmetic_v<Value> || std::is_enum_v<Value>, "Структуры пишутся по полям");
+    WriteValue(count);
+    WriteValue(sizeof(Value));
+    Write(data, count * sizeof(Value));
+    EndSection();
+}
+
+template <typename Value>
+void IndexFileWriter::WriteArray(ArrayView<Value> values) {
+    WriteArray(values.data(), values.size());
+}
+
+template <typename Value, typename WriteFields>
+void IndexFileWriter::WriteArray(ArrayView<Value> values, WriteFields write_fields) {
+    static_assert(std::is_trivially_copy_constructible_v<Value>, "В файл индекса пишутся только простые типы");
+    WriteValue(values.size());
+    WriteValue(sizeof(Value));
+    const size_t chunk_size = std::max<size_t>(RECORD_BUFFER_SIZE / sizeof(Value), 1);
+    std::vector<char> records(std::min(values.size(), chunk_size) * sizeof(Value));
+    for (size_t begin = 0; begin < values.size(); begin += chunk_size) {
+        const size_t end = std::min(values.size(), begin + chunk_size);
+        std::fill(records.begin(), records.end(), 0);
+        for (size_t index = begin; index < end; ++index) {
+            write_fields(values[index], records.data() + (index - begin) * sizeof(Value));
+        }
+        Write(records.data(), (end - begin) * sizeof(Value));
+    }
+    EndSection();
+}
+
+template <typename Value>
+ArrayView<Value> IndexFileReader::ReadArray() {
+    static_assert(std::is_trivially_copy_constructible_v<Value>, "Из файла индекса читаются только простые типы");
+    const uint64_t count = ReadValue();
+    if (ReadValue() != sizeof(Value)) {
+        throw std::runtime_error("Несовместимый формат файла индекса");
+    }
+    if (count > file_->size() / sizeof(Value)) {
+        throw std::runtime_error("Файл индекса повреждён");
+    }
+    return { reinterpret_cast<const Value*>(Take(count * sizeof(Value))), static_cast<size_t>(count) };
+}
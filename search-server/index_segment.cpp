@@ -0,0 +1,416 @@
+#include "index_segment.h"
+#include "head_segment.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+constexpr int REMOVED_DOCUMENT_ID = -1;
+
+void CheckIndexFile(bool condition) {
+    if (!condition) {
+        throw std::runtime_error("Файл индекса повреждён");
+    }
+}
+
+// Смещения начал элементов: от нуля, не убывают и не выходят за столбец
+bool AreOffsetsValid(ArrayView<size_t> offsets, size_t size) {
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        if (offsets[i] > size || (i == 0 ? offsets[i] != 0 : offsets[i] < offsets[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+IndexSegment::IndexSegment(DocumentOrdinal first_ordinal)
+    : first_ordinal_(first_ordinal)
+{
+    storage_.text_offsets.push_back(0);
+    storage_.word_freq_offsets.push_back(0);
+}
+
+IndexSegment::IndexSegment(IndexFileReader& reader, size_t term_count)
+    : first_ordinal_(static_cast<DocumentOrdinal>(reader.ReadValue()))
+    , file_(reader.GetFile())
+    , document_ids_(reader.ReadArray<int>())
+    , ratings_(reader.ReadArray<int>())
+    , statuses_(reader.ReadArray<DocumentStatus>())
+    , texts_(reader.ReadArray<char>())
+    , text_offsets_(reader.ReadArray<size_t>())
+    , word_freqs_(reader.ReadArray<WordFreq>())
+    , word_freq_offsets_(reader.ReadArray<size_t>())
+    , document_index_(reader.ReadArray<std::pair<int, DocumentOrdinal>>())
+    , terms_(reader.ReadArray<TermPostings>())
+    , blocks_(reader.ReadArray<PostingBlock>())
+    , block_data_(reader.ReadArray<uint32_t>())
+    , posting_count_(static_cast<size_t>(reader.ReadValue()))
+{
+    CheckFileColumns(term_count);
+    BuildStatusBitmaps();
+}
+
+IndexSegment::IndexSegment(std::shared_ptr<const HeadSegment> head)
+    : first_ordinal_(head->GetFirstOrdinal())
+    , head_(std::move(head))
+    , document_ids_(head_->GetDocumentIds())
+    , ratings_(head_->GetRatings())
+    , statuses_(head_->GetStatuses())
+    , texts_(head_->GetTexts())
+    , text_offsets_(head_->GetTextOffsets())
+    , word_freqs_(head_->GetWordFreqs())
+    , word_freq_offsets_(head_->GetWordFreqOffsets())
+    , posting_count_(head_->GetPostingCount())
+{
+    for (size_t status_index = 0; status_index < STATUS_COUNT; ++status_index) {
+        status_counts_[status_index] = head_->GetStatusCount(static_cast<DocumentStatus>(status_index));
+    }
+}
+
+void IndexSegment::Reserve(size_t document_count, size_t text_size, size_t word_freq_count) {
+    storage_.document_index.reserve(document_count);
+    storage_.document_ids.reserve(document_count);
+    storage_.ratings.reserve(document_count);
+    storage_.statuses.reserve(document_count);
+    storage_.texts.reserve(text_size);
+    storage_.text_offsets.reserve(document_count + 1);
+    storage_.word_freqs.reserve(word_freq_count);
+    storage_.word_freq_offsets.reserve(document_count + 1);
+}
+
+void IndexSegment::AddDocument(int document_id, int rating, DocumentStatus status, std::string_view text, WordFreqs word_freqs) {
+    storage_.document_index.emplace_back(document_id, first_ordinal_ + static_cast<DocumentOrdinal>(storage_.document_ids.size()));
+    storage_.document_ids.push_back(document_id);
+    storage_.ratings.push_back(rating);
+    storage_.statuses.push_back(status);
+    storage_.texts.insert(storage_.texts.end(), text.begin(), text.end());
+    storage_.text_offsets.push_back(storage_.texts.size());
+    storage_.word_freqs.insert(storage_.word_freqs.end(), word_freqs.begin(), word_freqs.end());
+    storage_.word_freq_offsets.push_back(storage_.word_freqs.size());
+}
+
+void IndexSegment::AddPostings(TermId term_id, const PostingList& postings) {
+    CheckNextTerm(term_id);
+    if (postings.empty()) {
+        return;
+    }
+
+    TermPostings term;
+    term.term_id = term_id;
+    term.first_block = static_cast<uint32_t>(storage_.blocks.size());
+    postings.EncodeTo(storage_.blocks, storage_.block_data);
+    term.block_count = static_cast<uint32_t>(storage_.blocks.size()) - term.first_block;
+    term.posting_count = static_cast<uint32_t>(postings.size());
+    term.max_term_freq = postings.GetMaxTermFreq();
+    storage_.terms.push_back(term);
+    posting_count_ += postings.size();
+}
+
+void IndexSegment::AddPosting(TermId term_id, DocumentOrdinal ordinal, uint32_t term_count, uint32_t document_length) {
+    CheckNextTerm(term_id);
+
+    TermPostings term;
+    term.term_id = term_id;
+    term.first_block = static_cast<uint32_t>(storage_.blocks.size());
+    storage_.blocks.push_back(EncodePostingBlock(&ordinal, &term_count, &document_length, 1, storage_.block_data));
+    term.block_count = 1;
+    term.posting_count = 1;
+    term.max_term_freq = storage_.blocks.back().max_term_freq;
+    storage_.terms.push_back(term);
+    ++posting_count_;
+}
+
+void IndexSegment::Seal() {
+    std::sort(storage_.document_index.begin(), storage_.document_index.end());
+    storage_.terms.shrink_to_fit();
+    storage_.blocks.shrink_to_fit();
+    storage_.block_data.shrink_to_fit();
+
+    document_ids_ = ArrayView(storage_.document_ids);
+    ratings_ = ArrayView(storage_.ratings);
+    statuses_ = ArrayView(storage_.statuses);
+    texts_ = ArrayView(storage_.texts);
+    text_offsets_ = ArrayView(storage_.text_offsets);
+    word_freqs_ = ArrayView(storage_.word_freqs);
+    word_freq_offsets_ = ArrayView(storage_.word_freq_offsets);
+    document_index_ = ArrayView(storage_.document_index);
+    terms_ = ArrayView(storage_.terms);
+    blocks_ = ArrayView(storage_.blocks);
+    block_data_ = ArrayView(storage_.block_data);
+    BuildStatusBitmaps();
+}
+
+// Порядок разделов совпадает с порядком чтения в конструкторе из файла
+void IndexSegment::Save(IndexFileWriter& writer, const std::vector<TermId>& new_term_ids) const {
+    if (head_) {
+        throw std::logic_error("Снимок головного сегмента нельзя сохранить, не слив его");
+    }
+    writer.WriteValue(first_ordinal_);
+    writer.WriteArray(document_ids_);
+    writer.WriteArray(ratings_);
+    writer.WriteArray(statuses_);
+    writer.WriteArray(texts_);
+    writer.WriteArray(text_offsets_);
+    writer.WriteArray(word_freqs_, [&new_term_ids](const WordFreq& word_freq, char* record) {
+        WriteIndexField(record, offsetof(WordFreq, first), new_term_ids[word_freq.first]);
+        WriteIndexField(record, offsetof(WordFreq, second), word_freq.second);
+        });
+    writer.WriteArray(word_freq_offsets_);
+    using DocumentIndexEntry = std::pair<int, DocumentOrdinal>;
+    writer.WriteArray(document_index_, [](const DocumentIndexEntry& entry, char* record) {
+        WriteIndexField(record, offsetof(DocumentIndexEntry, first), entry.first);
+        WriteIndexField(record, offsetof(DocumentIndexEntry, second), entry.second);
+        });
+    writer.WriteArray(terms_, [&new_term_ids](const TermPostings& term, char* record) {
+        WriteIndexField(record, offsetof(TermPostings, term_id), new_term_ids[term.term_id]);
+        WriteIndexField(record, offsetof(TermPostings, first_block), term.first_block);
+        WriteIndexField(record, offsetof(TermPostings, block_count), term.block_count);
+        WriteIndexField(record, offsetof(TermPostings, posting_count), term.posting_count);
+        WriteIndexField(record, offsetof(TermPostings, max_term_freq), term.max_term_freq);
+        });
+    writer.WriteArray(blocks_, [](const PostingBlock& block, char* record) {
+        WriteIndexField(record, offsetof(PostingBlock, first_ordinal), block.first_ordinal);
+        WriteIndexField(record, offsetof(PostingBlock, last_ordinal), block.last_ordinal);
+        WriteIndexField(record, offsetof(PostingBlock, data_offset), block.data_offset);
+        WriteIndexField(record, offsetof(PostingBlock, posting_count), block.posting_count);
+        WriteIndexField(record, offsetof(PostingBlock, ordinal_bits), block.ordinal_bits);
+        WriteIndexField(record, offsetof(PostingBlock, count_bits), block.count_bits);
+        WriteIndexField(record, offsetof(PostingBlock, length_bits), block.length_bits);
+        WriteIndexField(record, offsetof(PostingBlock, max_term_freq), block.max_term_freq);
+        });
+    writer.WriteArray(block_data_);
+    writer.WriteValue(posting_count_);
+}
+
+bool IndexSegment::IsHeadSnapshot() const {
+    return head_ != nullptr;
+}
+
+size_t IndexSegment::GetStatusCount(DocumentStatus status) const {
+    const auto status_index = static_cast<size_t>(status);
+    if (status_index >= STATUS_COUNT) {
+        return static_cast<size_t>(std::count(statuses_.begin(), statuses_.end(), status));
+    }
+    return status_counts_[status_index];
+}
+
+void IndexSegment::BuildStatusBitmaps() {
+    const size_t word_count = (statuses_.size() + 63) / 64;
+    for (auto& bits : status_bits_) {
+        bits.assign(word_count, 0);
+    }
+    status_counts_.fill(0);
+    for (size_t index = 0; index < statuses_.size(); ++index) {
+        const auto status_index = static_cast<size_t>(statuses_[index]);
+        if (status_index < STATUS_COUNT) {
+            status_bits_[status_index][index / 64] |= uint64_t{ 1 } << (index % 64);
+            ++status_counts_[status_index];
+        }
+    }
+}
+
+// Проверяется всё, по чему потом адресуются столбцы и данные блоков:
+// смещения, номера документов, границы и ширины полей блоков. Сами
+// упакованные разности номеров не распаковываются.
+void IndexSegment::CheckFileColumns(size_t term_count) const {
+    const size_t document_count = document_ids_.size();
+    CheckIndexFile(ratings_.size() == document_count && statuses_.size() == document_count
+        && text_offsets_.size() == document_count + 1 && word_freq_offsets_.size() == document_count + 1);
+    CheckIndexFile(document_count <= std::numeric_limits<DocumentOrdinal>::max() - first_ordinal_);
+    CheckIndexFile(AreOffsetsValid(text_offsets_, texts_.size()) && AreOffsetsValid(word_freq_offsets_, word_freqs_.size()));
+    for (const WordFreq& word_freq : word_freqs_) {
+        CheckIndexFile(word_freq.first < term_count);
+    }
+
+    const DocumentOrdinal end_ordinal = GetEndOrdinal();
+    for (size_t i = 0; i < document_index_.size(); ++i) {
+        const auto [document_id, ordinal] = document_index_[i];
+        CheckIndexFile(ordinal >= first_ordinal_ && ordinal < end_ordinal
+            && document_ids_[ordinal - first_ordinal_] == document_id
+            && (i == 0 || document_index_[i - 1].first <= document_id));
+    }
+
+    for (const PostingBlock& block : blocks_) {
+        CheckIndexFile(block.posting_count > 0 && block.posting_count <= POSTING_BLOCK_SIZE
+            && block.ordinal_bits <= 32 && block.count_bits <= 32 && block.length_bits <= 32);
+        CheckIndexFile(block.first_ordinal >= first_ordinal_ && block.first_ordinal <= block.last_ordinal
+            && block.last_ordinal < end_ordinal);
+        CheckIndexFile(block.data_offset <= block_data_.size()
+            && GetPostingBlockDataSize(block) <= block_data_.size() - block.data_offset);
+    }
+
+    size_t posting_count = 0;
+    for (size_t i = 0; i < terms_.size(); ++i) {
+        const TermPostings& term = terms_[i];
+        CheckIndexFile(term.term_id < term_count && (i == 0 || terms_[i - 1].term_id < term.term_id));
+        CheckIndexFile(term.first_block <= blocks_.size() && term.block_count <= blocks_.size() - term.first_block);
+        size_t term_posting_count = 0;
+        for (uint32_t block = term.first_block; block < term.first_block + term.block_count; ++block) {
+            term_posting_count += blocks_[block].posting_count;
+        }
+        CheckIndexFile(term_posting_count == term.posting_count);
+        posting_count += term_posting_count;
+    }
+    CheckIndexFile(posting_count == posting_count_);
+}
+
+void IndexSegment::CheckNextTerm(TermId term_id) const {
+    if (!storage_.terms.empty() && storage_.terms.back().term_id >= term_id) {
+        throw std::logic_error("Слова сегмента должны добавляться по возрастанию");
+    }
+}
+
+DocumentOrdinal IndexSegment::GetFirstOrdinal() const {
+    return first_ordinal_;
+}
+
+DocumentOrdinal IndexSegment::GetEndOrdinal() const {
+    return first_ordinal_ + static_cast<DocumentOrdinal>(document_ids_.size());
+}
+
+size_t IndexSegment::GetPostingCount() const {
+    return posting_count_;
+}
+
+PostingListView IndexSegment::FindPostings(TermId term_id) const {
+    if (head_) {
+        return head_->FindPostings(term_id, GetEndOrdinal());
+    }
+    const auto it = std::lower_bound(terms_.begin(), terms_.end(), term_id,
+        [](const TermPostings& term, TermId value) {
+            return term.term_id < value;
+        });
+    if (it == terms_.end() || it->term_id != term_id) {
+        return {};
+    }
+    return PostingListView(blocks_.data() + it->first_block, it->block_count, block_data_.data(),
+        it->posting_count, it->max_term_freq);
+}
+
+// Сегменты обычно покрывают непересекающиеся диапазоны id, поэтому поиск
+// по чужому сегменту заканчивается сравнением с крайними id. Документ,
+// удалённый и добавленный снова, может лежать в сегменте дважды; тогда
+// возвращается более новый.
+std::optional<DocumentOrdinal> IndexSegment::FindDocument(int document_id) const {
+    if (head_) {
+        return head_->FindDocument(document_id, GetEndOrdinal());
+    }
+    if (document_index_.empty() || document_id < document_index_[0].first
+        || document_index_[document_index_.size() - 1].first < document_id) {
+        return std::nullopt;
+    }
+    const auto it = std::upper_bound(document_index_.begin(), document_index_.end(),
+        std::make_pair(document_id, std::numeric_limits<DocumentOrdinal>::max()));
+    if (it == document_index_.begin() || std::prev(it)->first != document_id) {
+        return std::nullopt;
+    }
+    return std::prev(it)->second;
+}
+
+std::string_view IndexSegment::GetText(DocumentOrdinal ordinal) const {
+    const size_t index = ordinal - first_ordinal_;
+    return std::string_view(texts_.data() + text_offsets_[index], text_offsets_[index + 1] - text_offsets_[index]);
+}
+
+WordFreqs IndexSegment::GetWordFreqs(DocumentOrdinal ordinal) const {
+    const size_t index = ordinal - first_ordinal_;
+    return { word_freqs_.data() + word_freq_offsets_[index], word_freqs_.data() + word_freq_offsets_[index + 1] };
+}
+
+std::vector<std::pair<TermId, PostingListView>> IndexSegment::GetHeadTerms() const {
+    return head_->GetTerms(GetEndOrdinal());
+}
+
+// Место с отрицательным id не содержит документа и тоже не переносится
+std::vector<DocumentOrdinal> ComputeMergedOrdinals(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+    const std::vector<bool>& removed_ordinals) {
+    const DocumentOrdinal first_ordinal = segments.front()->GetFirstOrdinal();
+    std::vector<DocumentOrdinal> merged_ordinals(removed_ordinals.size() + 1, first_ordinal);
+    auto segment = segments.begin();
+    DocumentOrdinal next_ordinal = first_ordinal;
+    for (size_t i = 0; i < removed_ordinals.size(); ++i) {
+        const DocumentOrdinal ordinal = first_ordinal + static_cast<DocumentOrdinal>(i);
+        while ((*segment)->GetEndOrdinal() <= ordinal) {
+            ++segment;
+        }
+        merged_ordinals[i] = next_ordinal;
+        if (!removed_ordinals[i] && (*segment)->GetFirstOrdinal() <= ordinal
+            && (*segment)->GetDocumentId(ordinal) != REMOVED_DOCUMENT_ID) {
+            ++next_ordinal;
+        }
+    }
+    merged_ordinals.back() = next_ordinal;
+    return merged_ordinals;
+}
+
+IndexSegment MergeIndexSegments(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+    const std::vector<bool>& removed_ordinals) {
+    if (segments.empty()) {
+        throw std::invalid_argument("Нет сегментов для слияния");
+    }
+
+    const DocumentOrdinal first_ordinal = segments.front()->GetFirstOrdinal();
+    IndexSegment result(first_ordinal);
+
+    const std::vector<DocumentOrdinal> merged_ordinals = ComputeMergedOrdinals(segments, removed_ordinals);
+    const auto is_removed = [&](DocumentOrdinal ordinal) {
+        return merged_ordinals[ordinal - first_ordinal + 1] == merged_ordinals[ordinal - first_ordinal];
+    };
+    const auto renumber = [&](DocumentOrdinal ordinal) {
+        return merged_ordinals[ordinal - first_ordinal];
+    };
+
+    // Тексты удалённых документов не копируются: слияние заодно уплотняет их
+    size_t text_size = 0;
+    size_t word_freq_count = 0;
+    for (const auto& segment : segments) {
+        for (DocumentOrdinal ordinal = segment->GetFirstOrdinal(); ordinal < segment->GetEndOrdinal(); ++ordinal) {
+            if (!is_removed(ordinal)) {
+                text_size += segment->GetText(ordinal).size();
+                word_freq_count += segment->GetWordFreqs(ordinal).size();
+            }
+        }
+    }
+    result.Reserve(merged_ordinals.back() - first_ordinal, text_size, word_freq_count);
+
+    for (const auto& segment : segments) {
+        for (DocumentOrdinal ordinal = segment->GetFirstOrdinal(); ordinal < segment->GetEndOrdinal(); ++ordinal) {
+            if (!is_removed(ordinal)) {
+                result.AddDocument(segment->GetDocumentId(ordinal), segment->GetRating(ordinal), segment->GetStatus(ordinal),
+                    segment->GetText(ordinal), segment->GetWordFreqs(ordinal));
+            }
+        }
+    }
+
+    // Списки слов всех сегментов пронумерованы по порядку сегментов, поэтому
+    // после сортировки пар (слово, номер списка) списки одного слова идут по
+    // возрастанию номеров документов
+    std::vector<PostingListView> views;
+    std::vector<std::pair<TermId, uint32_t>> term_views;
+    for (const auto& segment : segments) {
+        segment->ForEachTerm([&](TermId term_id, const PostingListView& postings) {
+            term_views.emplace_back(term_id, static_cast<uint32_t>(views.size()));
+            views.push_back(postings);
+            });
+    }
+    std::sort(term_views.begin(), term_views.end());
+
+    PostingList postings;
+    for (size_t i = 0; i < term_views.size();) {
+        const TermId term_id = term_views[i].first;
+        postings.Clear();
+        for (; i < term_views.size() && term_views[i].first == term_id; ++i) {
+            postings.AppendFiltered(views[term_views[i].second], is_removed, renumber);
+        }
+        result.AddPostings(term_id, postings);
+    }
+
+    result.Seal();
+    return result;
+}
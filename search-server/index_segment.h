@@ -0,0 +1,221 @@
+#pragma once
+
+#include "document.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+#include "array_view.h"
+#include "index_file.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using WordFreq = std::pair<TermId, double>;
+
+class HeadSegment;
+
+// Прямой список документа: его слова с частотами по возрастанию TermId
+struct WordFreqs {
+    const WordFreq* first = nullptr;
+    const WordFreq* last = nullptr;
+
+    const WordFreq* begin() const {
+        return first;
+    }
+
+    const WordFreq* end() const {
+        return last;
+    }
+
+    size_t size() const {
+        return last - first;
+    }
+};
+
+// Запечатанный сегмент индекса: документы с внутренними номерами из
+// [first_ordinal, end_ordinal) и списки вхождений их слов. Рейтинги, статусы,
+// тексты и прямые списки документов хранятся столбцами. Списки всех слов
+// целиком сжаты и уложены подряд в общие массивы блоков и данных, слова
+// отсортированы по TermId. Сегмент заполняется документами по порядку номеров
+// и словами по возрастанию TermId, затем запечатывается и больше не меняется,
+// поэтому его можно читать из нескольких потоков и сливать с соседними в фоне.
+// Запечатанный сегмент читается через столбцы ArrayView, которые указывают
+// либо на его собственные векторы, либо прямо в отображённый файл индекса.
+class IndexSegment {
+public:
+    explicit IndexSegment(DocumentOrdinal first_ordinal);
+
+    // Сегмент, столбцы которого лежат в отображённом файле; TermId его слов
+    // должны быть меньше term_count, иначе, как и при любом другом
+    // повреждении, бросается runtime_error
+    IndexSegment(IndexFileReader& reader, size_t term_count);
+
+    // Снимок головного сегмента: документы, дописанные в него к моменту
+    // вызова. Строится писателем головы; сам снимок не запечатывается и не
+    // сохраняется, а сливается в обычный сегмент
+    explicit IndexSegment(std::shared_ptr<const HeadSegment> head);
+
+    IndexSegment(IndexSegment&&) = default;
+    IndexSegment& operator=(IndexSegment&&) = default;
+
+    // Заранее выделяет столбцы под документы с текстами и прямыми списками
+    // заданного суммарного размера
+    void Reserve(size_t document_count, size_t text_size, size_t word_freq_count);
+
+    void AddDocument(int document_id, int rating, DocumentStatus status, std::string_view text, WordFreqs word_freqs);
+
+    void AddPostings(TermId term_id, const PostingList& postings);
+
+    void AddPosting(TermId term_id, DocumentOrdinal ordinal, uint32_t term_count, uint32_t document_length);
+
+    void Seal();
+
+    // Слова записываются под номерами new_term_ids[term_id]; замена не
+    // должна менять порядок номеров
+    void Save(IndexFileWriter& writer, const std::vector<TermId>& new_term_ids) const;
+
+    bool IsHeadSnapshot() const;
+
+    DocumentOrdinal GetFirstOrdinal() const;
+
+    DocumentOrdinal GetEndOrdinal() const;
+
+    size_t GetPostingCount() const;
+
+    PostingListView FindPostings(TermId term_id) const;
+
+    std::optional<DocumentOrdinal> FindDocument(int document_id) const;
+
+    int GetDocumentId(DocumentOrdinal ordinal) const;
+
+    int GetRating(DocumentOrdinal ordinal) const;
+
+    DocumentStatus GetStatus(DocumentOrdinal ordinal) const;
+
+    // Проверка статуса по битовой карте, без чтения столбца статусов
+    bool HasStatus(DocumentOrdinal ordinal, DocumentStatus status) const;
+
+    size_t GetStatusCount(DocumentStatus status) const;
+
+    std::string_view GetText(DocumentOrdinal ordinal) const;
+
+    WordFreqs GetWordFreqs(DocumentOrdinal ordinal) const;
+
+    // Вызывает function(term_id, postings) для слов по возрастанию TermId
+    template <typename Function>
+    void ForEachTerm(Function function) const;
+
+private:
+    struct TermPostings {
+        TermId term_id = 0;
+        uint32_t first_block = 0;
+        uint32_t block_count = 0;
+        uint32_t posting_count = 0;
+        double max_term_freq = 0.0;
+    };
+
+    // Столбцы строящегося сегмента; у отображённого из файла пусты
+    struct Storage {
+        std::vector<int> document_ids;
+        std::vector<int> ratings;
+        std::vector<DocumentStatus> statuses;
+        std::vector<char> texts;
+        std::vector<size_t> text_offsets;
+        std::vector<WordFreq> word_freqs;
+        std::vector<size_t> word_freq_offsets;
+        std::vector<std::pair<int, DocumentOrdinal>> document_index;
+        std::vector<TermPostings> terms;
+        std::vector<PostingBlock> blocks;
+        std::vector<uint32_t> block_data;
+    };
+
+    DocumentOrdinal first_ordinal_;
+    Storage storage_;
+    std::shared_ptr<const MappedFile> file_;
+    std::shared_ptr<const HeadSegment> head_;
+
+    ArrayView<int> document_ids_;
+    ArrayView<int> ratings_;
+    ArrayView<DocumentStatus> statuses_;
+    ArrayView<char> texts_;
+    ArrayView<size_t> text_offsets_;
+    ArrayView<WordFreq> word_freqs_;
+    ArrayView<size_t> word_freq_offsets_;
+    ArrayView<std::pair<int, DocumentOrdinal>> document_index_;
+
+    ArrayView<TermPostings> terms_;
+    ArrayView<PostingBlock> blocks_;
+    ArrayView<uint32_t> block_data_;
+    size_t posting_count_ = 0;
+
+    static constexpr size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+    // Битовые карты номеров документов каждого статуса строятся заново при
+    // запечатывании и при открытии файла; у снимка головы их нет
+    std::array<std::vector<uint64_t>, STATUS_COUNT> status_bits_;
+    std::array<size_t, STATUS_COUNT> status_counts_{};
+
+    void CheckNextTerm(TermId term_id) const;
+
+    void CheckFileColumns(size_t term_count) const;
+
+    void BuildStatusBitmaps();
+
+    std::vector<std::pair<TermId, PostingListView>> GetHeadTerms() const;
+};
+
+// Сливает сегменты (по возрастанию номеров) в один, выбрасывая документы,
+// отмеченные в removed_ordinals, вместе с их вхождениями. Оставшиеся
+// документы перенумеровываются подряд с первого номера первого сегмента, так
+// что выброшенные и промежутки между сегментами места не занимают. Флаги
+// удаления индексируются номером документа относительно начала первого
+// сегмента и покрывают всё до конца последнего.
+IndexSegment MergeIndexSegments(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+    const std::vector<bool>& removed_ordinals);
+
+// Номера документов в сегменте, который построит MergeIndexSegments: для
+// каждого номера из диапазона removed_ordinals — новый номер документа, а для
+// выброшенного или промежутка — номер следующего оставшегося; последний
+// элемент — конец слитого сегмента.
+std::vector<DocumentOrdinal> ComputeMergedOrdinals(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+    const std::vector<bool>& removed_ordinals);
+
+inline int IndexSegment::GetDocumentId(DocumentOrdinal ordinal) const {
+    return document_ids_[ordinal - first_ordinal_];
+}
+
+inline int IndexSegment::GetRating(DocumentOrdinal ordinal) const {
+    return ratings_[ordinal - first_ordinal_];
+}
+
+inline DocumentStatus IndexSegment::GetStatus(DocumentOrdinal ordinal) const {
+    return statuses_[ordinal - first_ordinal_];
+}
+
+inline bool IndexSegment::HasStatus(DocumentOrdinal ordinal, DocumentStatus status) const {
+    const auto status_index = static_cast<size_t>(status);
+    if (status_index >= STATUS_COUNT || head_) {
+        return GetStatus(ordinal) == status;
+    }
+    const size_t index = ordinal - first_ordinal_;
+    return (status_bits_[status_index][index / 64] >> (index % 64)) & 1;
+}
+
+template <typename Function>
+void IndexSegment::ForEachTerm(Function function) const {
+    if (head_) {
+        for (const auto& [term_id, postings] : GetHeadTerms()) {
+            function(term_id, postings);
+        }
+        return;
+    }
+    for (const TermPostings& term : terms_) {
+        function(term.term_id, PostingListView(blocks_.data() + term.first_block, term.block_count, block_data_.data(),
+            term.posting_count, term.max_term_freq));
+    }
+}
@@ -0,0 +1,92 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+unsigned FindHighestBit(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+}
+
+} // namespace
+
+void LatencyHistogram::Add(std::chrono::nanoseconds latency) {
+    const uint64_t value = latency.count() > 0 ? static_cast<uint64_t>(latency.count()) : 0;
+    counts_[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Clear() {
+    for (auto& count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        const uint64_t count = other.counts_[i].load(std::memory_order_relaxed);
+        if (count != 0) {
+            counts_[i].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    uint64_t total = 0;
+    for (const auto& count : counts_) {
+        total += count.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetPercentile(double percentile) const {
+    const uint64_t total = GetCount();
+    if (total == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    const double share = std::clamp(percentile, 0.0, 100.0) / 100.0;
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(share * total)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::chrono::nanoseconds(GetBucketUpperBound(i));
+        }
+    }
+    return std::chrono::nanoseconds(GetBucketUpperBound(BUCKET_COUNT - 1));
+}
+
+// Значения меньше SUB_BUCKET_COUNT лежат каждое в своей корзине; у больших
+// старший бит задаёт степень двойки, а следующие за ним
+// LATENCY_HISTOGRAM_SUB_BUCKET_BITS бит — корзину внутри неё
+size_t LatencyHistogram::GetBucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    const unsigned exponent = FindHighestBit(value);
+    if (exponent > LATENCY_HISTOGRAM_MAX_EXPONENT) {
+        return BUCKET_COUNT - 1;
+    }
+    const unsigned shift = exponent - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    return (exponent - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT
+        + static_cast<size_t>((value >> shift) & (SUB_BUCKET_COUNT - 1));
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    const size_t shift = index / SUB_BUCKET_COUNT - 1;
+    const uint64_t lower = (SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT) << shift;
+    return lower + (uint64_t{ 1 } << shift) - 1;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+const size_t LATENCY_HISTOGRAM_SUB_BUCKET_BITS = 4;
+const size_t LATENCY_HISTOGRAM_MAX_EXPONENT = 40;
+
+// Гистограмма задержек в наносекундах в духе HDR Histogram: каждая степень
+// двойки делится на 2^LATENCY_HISTOGRAM_SUB_BUCKET_BITS равных корзин, так
+// что относительная погрешность не больше 1/16. Задержки от
+// 2^(LATENCY_HISTOGRAM_MAX_EXPONENT + 1) нс попадают в последнюю корзину.
+// Корзины — атомарные счётчики, поэтому Add можно вызывать из многих потоков.
+class LatencyHistogram {
+public:
+    static constexpr size_t SUB_BUCKET_COUNT = size_t{ 1 } << LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT =
+        (LATENCY_HISTOGRAM_MAX_EXPONENT - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 2) * SUB_BUCKET_COUNT;
+
+    void Add(std::chrono::nanoseconds latency);
+
+    void Clear();
+
+    // Прибавляет счётчики other к своим
+    void Merge(const LatencyHistogram& other);
+
+    uint64_t GetCount() const;
+
+    // Верхняя граница корзины, до которой набирается percentile процентов
+    // задержек; 0 для пустой гистограммы
+    std::chrono::nanoseconds GetPercentile(double percentile) const;
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> counts_{};
+
+    static size_t GetBucketIndex(uint64_t value);
+
+    static uint64_t GetBucketUpperBound(size_t index);
+};
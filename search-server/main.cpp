@@ -1,5 +1,7 @@
 #include "process_queries.h"
+#include "request_queue.h"
 #include "search_server.h"
+#include "test_example_functions.h"
 #include <execution>
 #include <iostream>
 #include <string>
@@ -11,7 +13,14 @@ void PrintDocument(const Document& document) {
         << "relevance = "s << document.relevance << ", "s
         << "rating = "s << document.rating << " }"s << endl;
 }
-int main() {
+int main(int argc, char* argv[]) {
+    //        RequestQueue, 
+    //     --test
+    if (argc > 1 && argv[1] == "--test"s) {
+        TestSearchServer();
+        cout << "Tests passed"s << endl;
+        return 0;
+    }
     SearchServer search_server("and with"s);
     int id = 0;
     for (
@@ -39,5 +48,14 @@ int main() {
     for (const Document& document : search_server.FindTopDocuments(execution::par, "curly nasty cat"s, [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 0; })) {
         PrintDocument(document);
     }
+    RequestQueue request_queue(search_server);
+    for (int i = 0; i < 3; ++i) {
+        request_queue.AddFindRequest("empty request"s);
+    }
+    request_queue.AddFindRequest("curly dog"s);
+    //          
+    //   24 ,     1440 ;   4
+    //   , 3    
+    cout << "Total empty requests: "s << request_queue.GetNoResultRequests() << endl;
     return 0;
 }
\ No newline at end of file
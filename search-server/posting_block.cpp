@@ -0,0 +1,128 @@
+#include "posting_block.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+uint8_t BitWidth(uint32_t value) {
+    uint8_t bits = 0;
+    while (value) {
+        ++bits;
+        value >>= 1;
+    }
+    return bits;
+}
+
+// Упакованная последовательность дополняется одним нулевым словом, чтобы
+// распаковка могла всегда читать по 64 бита без проверки границы.
+void PackBits(const uint32_t* values, size_t count, uint8_t bits, std::vector<uint32_t>& out) {
+    if (bits == 0) {
+        return;
+    }
+    const size_t word_count = (count * bits + 31) / 32 + 1;
+    const size_t base = out.size();
+    out.resize(base + word_count, 0);
+
+    for (size_t i = 0; i < count; ++i) {
+        const size_t bit = i * bits;
+        const uint64_t value = static_cast<uint64_t>(values[i]) << (bit % 32);
+        out[base + bit / 32] |= static_cast<uint32_t>(value);
+        out[base + bit / 32 + 1] |= static_cast<uint32_t>(value >> 32);
+    }
+}
+
+size_t PackedWordCount(size_t count, uint8_t bits) {
+    return bits == 0 ? 0 : (count * bits + 31) / 32 + 1;
+}
+
+template <unsigned Bits>
+void UnpackBits(const uint32_t* in, uint32_t* out, size_t count) {
+    if constexpr (Bits == 0) {
+        std::fill(out, out + count, 0u);
+    }
+    else {
+        constexpr uint64_t mask = (uint64_t{ 1 } << Bits) - 1;
+        for (size_t i = 0; i < count; ++i) {
+            const size_t bit = i * Bits;
+            const uint64_t word = in[bit / 32] | (static_cast<uint64_t>(in[bit / 32 + 1]) << 32);
+            out[i] = static_cast<uint32_t>((word >> (bit % 32)) & mask);
+        }
+    }
+}
+
+using UnpackFunction = void (*)(const uint32_t*, uint32_t*, size_t);
+
+template <size_t... Bits>
+constexpr std::array<UnpackFunction, sizeof...(Bits)> MakeUnpackTable(std::index_sequence<Bits...>) {
+    return { &UnpackBits<Bits>... };
+}
+
+constexpr auto UNPACK_TABLE = MakeUnpackTable(std::make_index_sequence<33>{});
+
+}  // namespace
+
+PostingBlock EncodePostingBlock(const DocumentOrdinal* ordinals, const uint32_t* term_counts,
+    const uint32_t* document_lengths, size_t posting_count, std::vector<uint32_t>& block_data) {
+    if (posting_count == 0 || posting_count > POSTING_BLOCK_SIZE) {
+        throw std::invalid_argument("Недопустимый размер блока вхождений");
+    }
+
+    std::array<uint32_t, POSTING_BLOCK_SIZE> gaps;
+    gaps[0] = 0;
+    uint32_t max_gap = 0;
+    for (size_t i = 1; i < posting_count; ++i) {
+        gaps[i] = ordinals[i] - ordinals[i - 1];
+        max_gap = std::max(max_gap, gaps[i]);
+    }
+
+    PostingBlock block;
+    block.first_ordinal = ordinals[0];
+    block.last_ordinal = ordinals[posting_count - 1];
+    block.data_offset = static_cast<uint32_t>(block_data.size());
+    block.posting_count = static_cast<uint16_t>(posting_count);
+    block.ordinal_bits = BitWidth(max_gap);
+    block.count_bits = BitWidth(*std::max_element(term_counts, term_counts + posting_count));
+    block.length_bits = BitWidth(*std::max_element(document_lengths, document_lengths + posting_count));
+    for (size_t i = 0; i < posting_count; ++i) {
+        block.max_term_freq = std::max(block.max_term_freq, ComputeTermFreq(term_counts[i], document_lengths[i]));
+    }
+
+    PackBits(gaps.data(), posting_count, block.ordinal_bits, block_data);
+    PackBits(term_counts, posting_count, block.count_bits, block_data);
+    PackBits(document_lengths, posting_count, block.length_bits, block_data);
+
+    return block;
+}
+
+void DecodePostingBlock(const PostingBlock& block, const uint32_t* block_data,
+    DocumentOrdinal* ordinals, uint32_t* term_counts, uint32_t* document_lengths) {
+    const size_t count = block.posting_count;
+    const uint32_t* data = block_data + block.data_offset;
+
+    UNPACK_TABLE[block.ordinal_bits](data, ordinals, count);
+    data += PackedWordCount(count, block.ordinal_bits);
+    UNPACK_TABLE[block.count_bits](data, term_counts, count);
+    data += PackedWordCount(count, block.count_bits);
+    UNPACK_TABLE[block.length_bits](data, document_lengths, count);
+
+    // Сумма без переполнения, сошедшаяся с last_ordinal, гарантирует, что
+    // все номера лежат в [first_ordinal, last_ordinal], даже если данные
+    // блока в файле индекса испорчены
+    uint64_t ordinal = block.first_ordinal;
+    for (size_t i = 0; i < count; ++i) {
+        ordinal += ordinals[i];
+        ordinals[i] = static_cast<DocumentOrdinal>(ordinal);
+    }
+    if (ordinal != block.last_ordinal) {
+        throw std::runtime_error("Файл индекса повреждён");
+    }
+}
+
+size_t GetPostingBlockDataSize(const PostingBlock& block) {
+    return PackedWordCount(block.posting_count, block.ordinal_bits)
+        + PackedWordCount(block.posting_count, block.count_bits)
+        + PackedWordCount(block.posting_count, block.length_bits);
+}
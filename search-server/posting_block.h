@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using DocumentOrdinal = uint32_t;
+
+inline constexpr size_t POSTING_BLOCK_SIZE = 128;
+
+// Заголовок сжатого блока вхождений. Он же служит метаданными для пропуска:
+// по first_ordinal/last_ordinal курсор решает, нужно ли распаковывать блок.
+// Разности соседних номеров документов, количество вхождений слова и длина
+// документа упакованы в block_data по ordinal_bits/count_bits/length_bits бит.
+struct PostingBlock {
+    DocumentOrdinal first_ordinal = 0;
+    DocumentOrdinal last_ordinal = 0;
+    uint32_t data_offset = 0;
+    uint16_t posting_count = 0;
+    uint8_t ordinal_bits = 0;
+    uint8_t count_bits = 0;
+    uint8_t length_bits = 0;
+    double max_term_freq = 0.0;
+};
+
+inline double ComputeTermFreq(uint32_t term_count, uint32_t document_length) {
+    return static_cast<double>(term_count) / document_length;
+}
+
+PostingBlock EncodePostingBlock(const DocumentOrdinal* ordinals, const uint32_t* term_counts,
+    const uint32_t* document_lengths, size_t posting_count, std::vector<uint32_t>& block_data);
+
+void DecodePostingBlock(const PostingBlock& block, const uint32_t* block_data,
+    DocumentOrdinal* ordinals, uint32_t* term_counts, uint32_t* document_lengths);
+
+// Число слов block_data, занятых упакованными данными блока
+size_t GetPostingBlockDataSize(const PostingBlock& block);
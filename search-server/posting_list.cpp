@@ -0,0 +1,244 @@
+#include "posting_list.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void PostingList::Append(DocumentOrdinal ordinal, uint32_t term_count, uint32_t document_length) {
+    const bool has_last = !tail_ordinals_.empty() || !blocks_.empty();
+    const DocumentOrdinal last = !tail_ordinals_.empty() ? tail_ordinals_.back()
+        : !blocks_.empty() ? blocks_.back().last_ordinal : 0;
+    if (has_last && last >= ordinal) {
+        throw std::logic_error("Номера документов в списке вхождений должны возрастать");
+    }
+
+    tail_ordinals_.push_back(ordinal);
+    tail_term_counts_.push_back(term_count);
+    tail_document_lengths_.push_back(document_length);
+    tail_max_term_freq_ = std::max(tail_max_term_freq_, ComputeTermFreq(term_count, document_length));
+    max_term_freq_ = std::max(max_term_freq_, tail_max_term_freq_);
+    ++size_;
+
+    if (tail_ordinals_.size() == POSTING_BLOCK_SIZE) {
+        FlushTail();
+    }
+}
+
+void PostingList::FlushTail() {
+    blocks_.push_back(EncodePostingBlock(tail_ordinals_.data(), tail_term_counts_.data(),
+        tail_document_lengths_.data(), tail_ordinals_.size(), block_data_));
+    tail_ordinals_.clear();
+    tail_term_counts_.clear();
+    tail_document_lengths_.clear();
+    tail_max_term_freq_ = 0.0;
+}
+
+// Блок берётся из чужого списка целиком, вместе с упакованными данными:
+// там хранятся только разности номеров, поэтому сдвиг меняет лишь границы
+void PostingList::AppendBlock(const PostingBlock& block, const uint32_t* block_data, DocumentOrdinal first_ordinal) {
+    if (!blocks_.empty() && blocks_.back().last_ordinal >= first_ordinal) {
+        throw std::logic_error("Номера документов в списке вхождений должны возрастать");
+    }
+
+    PostingBlock copy = block;
+    copy.first_ordinal = first_ordinal;
+    copy.last_ordinal = first_ordinal + (block.last_ordinal - block.first_ordinal);
+    copy.data_offset = static_cast<uint32_t>(block_data_.size());
+    const uint32_t* data = block_data + block.data_offset;
+    block_data_.insert(block_data_.end(), data, data + GetPostingBlockDataSize(block));
+    blocks_.push_back(copy);
+    max_term_freq_ = std::max(max_term_freq_, block.max_term_freq);
+    size_ += block.posting_count;
+}
+
+void PostingList::Clear() {
+    blocks_.clear();
+    block_data_.clear();
+    tail_ordinals_.clear();
+    tail_term_counts_.clear();
+    tail_document_lengths_.clear();
+    tail_max_term_freq_ = 0.0;
+    max_term_freq_ = 0.0;
+    size_ = 0;
+}
+
+size_t PostingList::size() const {
+    return size_;
+}
+
+bool PostingList::empty() const {
+    return size_ == 0;
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+PostingListView PostingList::GetView() const {
+    PostingListView view(blocks_.data(), blocks_.size(), block_data_.data(), size_, max_term_freq_);
+    view.tail_ordinals_ = tail_ordinals_.data();
+    view.tail_term_counts_ = tail_term_counts_.data();
+    view.tail_document_lengths_ = tail_document_lengths_.data();
+    view.tail_size_ = tail_ordinals_.size();
+    view.tail_max_term_freq_ = tail_max_term_freq_;
+    return view;
+}
+
+void PostingList::EncodeTo(std::vector<PostingBlock>& blocks, std::vector<uint32_t>& block_data) const {
+    const auto data_offset = static_cast<uint32_t>(block_data.size());
+    block_data.insert(block_data.end(), block_data_.begin(), block_data_.end());
+    for (PostingBlock block : blocks_) {
+        block.data_offset += data_offset;
+        blocks.push_back(block);
+    }
+    if (!tail_ordinals_.empty()) {
+        blocks.push_back(EncodePostingBlock(tail_ordinals_.data(), tail_term_counts_.data(),
+            tail_document_lengths_.data(), tail_ordinals_.size(), block_data));
+    }
+}
+
+PostingListView::PostingListView(const PostingBlock* blocks, size_t block_count, const uint32_t* block_data,
+    size_t size, double max_term_freq)
+    : blocks_(blocks)
+    , block_count_(block_count)
+    , block_data_(block_data)
+    , max_term_freq_(max_term_freq)
+    , size_(size)
+{
+}
+
+PostingListView::PostingListView(const DocumentOrdinal* ordinals, const uint32_t* term_counts, const uint32_t* document_lengths,
+    size_t size, double max_term_freq)
+    : tail_ordinals_(ordinals)
+    , tail_term_counts_(term_counts)
+    , tail_document_lengths_(document_lengths)
+    , tail_size_(size)
+    , tail_max_term_freq_(max_term_freq)
+    , max_term_freq_(max_term_freq)
+    , size_(size)
+{
+}
+
+std::optional<double> PostingListView::FindTermFreq(DocumentOrdinal ordinal) const {
+    PostingCursor cursor(*this);
+    cursor.Advance(ordinal);
+    if (cursor.IsEnd() || cursor.GetOrdinal() != ordinal) {
+        return std::nullopt;
+    }
+    return cursor.GetTermFreq();
+}
+
+bool PostingListView::Contains(DocumentOrdinal ordinal) const {
+    return FindTermFreq(ordinal).has_value();
+}
+
+size_t PostingListView::size() const {
+    return size_;
+}
+
+bool PostingListView::empty() const {
+    return size_ == 0;
+}
+
+double PostingListView::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+PostingCursor::PostingCursor(const PostingListView& postings)
+    : postings_(postings)
+{
+    LoadChunk(0);
+}
+
+bool PostingCursor::IsEnd() const {
+    return position_ >= chunk_size_;
+}
+
+DocumentOrdinal PostingCursor::GetOrdinal() const {
+    return ordinals_[position_];
+}
+
+double PostingCursor::GetTermFreq() const {
+    return ComputeTermFreq(term_counts_[position_], document_lengths_[position_]);
+}
+
+uint32_t PostingCursor::GetTermCount() const {
+    return term_counts_[position_];
+}
+
+uint32_t PostingCursor::GetDocumentLength() const {
+    return document_lengths_[position_];
+}
+
+void PostingCursor::Next() {
+    if (++position_ == chunk_size_) {
+        LoadChunk(chunk_index_ + 1);
+    }
+}
+
+void PostingCursor::Advance(DocumentOrdinal target) {
+    if (IsEnd() || GetOrdinal() >= target) {
+        return;
+    }
+
+    if (ordinals_[chunk_size_ - 1] < target) {
+        const PostingBlock* const blocks = postings_.blocks_;
+        const size_t block_count = postings_.block_count_;
+        const auto block_it = std::lower_bound(blocks + std::min(chunk_index_ + 1, block_count), blocks + block_count, target,
+            [](const PostingBlock& block, DocumentOrdinal value) {
+                return block.last_ordinal < value;
+            });
+        size_t chunk_index = block_it - blocks;
+        if (chunk_index == block_count) {
+            const DocumentOrdinal* const tail = postings_.tail_ordinals_;
+            chunk_index += (std::lower_bound(tail, tail + postings_.tail_size_, target) - tail) / POSTING_BLOCK_SIZE;
+        }
+        LoadChunk(chunk_index);
+        if (IsEnd()) {
+            return;
+        }
+    }
+
+    position_ = std::lower_bound(ordinals_.begin() + position_, ordinals_.begin() + chunk_size_, target) - ordinals_.begin();
+    if (position_ == chunk_size_) {
+        LoadChunk(chunk_index_ + 1);
+    }
+}
+
+PostingBlockBound PostingCursor::PeekBlock(DocumentOrdinal target) const {
+    const PostingBlock* const blocks = postings_.blocks_;
+    const size_t block_count = postings_.block_count_;
+    const auto block_it = std::lower_bound(blocks + std::min(chunk_index_, block_count), blocks + block_count, target,
+        [](const PostingBlock& block, DocumentOrdinal value) {
+            return block.last_ordinal < value;
+        });
+    if (block_it != blocks + block_count) {
+        return { block_it->last_ordinal, block_it->max_term_freq };
+    }
+
+    const size_t tail_size = postings_.tail_size_;
+    if (tail_size > 0 && postings_.tail_ordinals_[tail_size - 1] >= target) {
+        return { postings_.tail_ordinals_[tail_size - 1], postings_.tail_max_term_freq_ };
+    }
+    return {};
+}
+
+void PostingCursor::LoadChunk(size_t chunk_index) {
+    chunk_index_ = chunk_index;
+    position_ = 0;
+
+    if (chunk_index < postings_.block_count_) {
+        const PostingBlock& block = postings_.blocks_[chunk_index];
+        DecodePostingBlock(block, postings_.block_data_, ordinals_.data(), term_counts_.data(), document_lengths_.data());
+        chunk_size_ = block.posting_count;
+    }
+    else if (const size_t tail_begin = (chunk_index - postings_.block_count_) * POSTING_BLOCK_SIZE; tail_begin < postings_.tail_size_) {
+        // Хвост головного сегмента бывает длиннее блока и читается кусками
+        chunk_size_ = std::min(POSTING_BLOCK_SIZE, postings_.tail_size_ - tail_begin);
+        std::copy_n(postings_.tail_ordinals_ + tail_begin, chunk_size_, ordinals_.begin());
+        std::copy_n(postings_.tail_term_counts_ + tail_begin, chunk_size_, term_counts_.begin());
+        std::copy_n(postings_.tail_document_lengths_ + tail_begin, chunk_size_, document_lengths_.begin());
+    }
+    else {
+        chunk_size_ = 0;
+    }
+}
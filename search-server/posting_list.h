@@ -0,0 +1,207 @@
+#pragma once
+
+#include "posting_block.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+class PostingList;
+
+// Неизменяемое представление списка вхождений: сжатые блоки и, возможно,
+// несжатый хвост, лежащие в чужих массивах (списке PostingList или
+// запечатанном сегменте индекса). Копируется дёшево и валидно, пока жив
+// владелец массивов и он не меняется.
+class PostingListView {
+public:
+    PostingListView() = default;
+
+    PostingListView(const PostingBlock* blocks, size_t block_count, const uint32_t* block_data,
+        size_t size, double max_term_freq);
+
+    // Только несжатые вхождения, по возрастанию номеров документов; в
+    // отличие от хвоста PostingList их может быть больше блока
+    PostingListView(const DocumentOrdinal* ordinals, const uint32_t* term_counts, const uint32_t* document_lengths,
+        size_t size, double max_term_freq);
+
+    std::optional<double> FindTermFreq(DocumentOrdinal ordinal) const;
+
+    bool Contains(DocumentOrdinal ordinal) const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    double GetMaxTermFreq() const;
+
+    template <typename Function>
+    void ForEach(Function function) const;
+
+    // Обходит только вхождения с номерами документов из [begin, end),
+    // пропуская блоки за пределами диапазона без распаковки.
+    template <typename Function>
+    void ForEachInRange(DocumentOrdinal begin, DocumentOrdinal end, Function function) const;
+
+private:
+    friend class PostingList;
+    friend class PostingCursor;
+
+    const PostingBlock* blocks_ = nullptr;
+    size_t block_count_ = 0;
+    const uint32_t* block_data_ = nullptr;
+    const DocumentOrdinal* tail_ordinals_ = nullptr;
+    const uint32_t* tail_term_counts_ = nullptr;
+    const uint32_t* tail_document_lengths_ = nullptr;
+    size_t tail_size_ = 0;
+    double tail_max_term_freq_ = 0.0;
+    double max_term_freq_ = 0.0;
+    size_t size_ = 0;
+};
+
+// Список вхождений слова, упорядоченный по внутренним порядковым номерам
+// документов. Полные блоки по POSTING_BLOCK_SIZE вхождений хранятся сжатыми
+// (разности номеров и частоты упакованы по битам), последние добавленные
+// вхождения лежат несжатым хвостом, пока их не наберётся на целый блок.
+// Частота слова хранится точно, как пара "число вхождений / длина документа".
+class PostingList {
+public:
+    void Append(DocumentOrdinal ordinal, uint32_t term_count, uint32_t document_length);
+
+    size_t size() const;
+
+    bool empty() const;
+
+    double GetMaxTermFreq() const;
+
+    // Дописывает вхождения postings, кроме документов, для которых
+    // is_removed(ordinal) истинно, под номерами renumber(ordinal). renumber
+    // не убывает и на удалённом номере даёт номер следующего оставшегося
+    // документа, поэтому полный блок без удалённых внутри его диапазона
+    // переносится без перепаковки, только со сдвигом границ.
+    template <typename IsRemoved, typename Renumber>
+    void AppendFiltered(const PostingListView& postings, IsRemoved is_removed, Renumber renumber);
+
+    void Clear();
+
+    PostingListView GetView() const;
+
+    // Дописывает весь список, включая хвост, сжатыми блоками в чужие массивы.
+    void EncodeTo(std::vector<PostingBlock>& blocks, std::vector<uint32_t>& block_data) const;
+
+private:
+    std::vector<PostingBlock> blocks_;
+    std::vector<uint32_t> block_data_;
+    std::vector<DocumentOrdinal> tail_ordinals_;
+    std::vector<uint32_t> tail_term_counts_;
+    std::vector<uint32_t> tail_document_lengths_;
+    double tail_max_term_freq_ = 0.0;
+    double max_term_freq_ = 0.0;
+    size_t size_ = 0;
+
+    void FlushTail();
+
+    // Блок переносится с первым номером first_ordinal
+    void AppendBlock(const PostingBlock& block, const uint32_t* block_data, DocumentOrdinal first_ordinal);
+};
+
+// Верхняя граница частоты слова на участке списка, заканчивающемся last_ordinal.
+struct PostingBlockBound {
+    DocumentOrdinal last_ordinal = std::numeric_limits<DocumentOrdinal>::max();
+    double max_term_freq = 0.0;
+};
+
+// Последовательный проход по списку вхождений с возможностью перескочить
+// вперёд: Advance пропускает целые блоки по их метаданным, не распаковывая их.
+class PostingCursor {
+public:
+    explicit PostingCursor(const PostingListView& postings);
+
+    bool IsEnd() const;
+
+    DocumentOrdinal GetOrdinal() const;
+
+    double GetTermFreq() const;
+
+    uint32_t GetTermCount() const;
+
+    uint32_t GetDocumentLength() const;
+
+    void Next();
+
+    void Advance(DocumentOrdinal target);
+
+    PostingBlockBound PeekBlock(DocumentOrdinal target) const;
+
+private:
+    PostingListView postings_;
+    size_t chunk_index_ = 0;
+    size_t chunk_size_ = 0;
+    size_t position_ = 0;
+    std::array<DocumentOrdinal, POSTING_BLOCK_SIZE> ordinals_;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> term_counts_;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> document_lengths_;
+
+    void LoadChunk(size_t chunk_index);
+};
+
+template <typename IsRemoved, typename Renumber>
+void PostingList::AppendFiltered(const PostingListView& postings, IsRemoved is_removed, Renumber renumber) {
+    std::array<DocumentOrdinal, POSTING_BLOCK_SIZE> ordinals;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> term_counts;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> document_lengths;
+
+    for (size_t i = 0; i < postings.block_count_; ++i) {
+        const PostingBlock& block = postings.blocks_[i];
+        const DocumentOrdinal first_ordinal = renumber(block.first_ordinal);
+        if (tail_ordinals_.empty() && block.posting_count == POSTING_BLOCK_SIZE && !is_removed(block.last_ordinal)
+            && renumber(block.last_ordinal) - first_ordinal == block.last_ordinal - block.first_ordinal) {
+            AppendBlock(block, postings.block_data_, first_ordinal);
+            continue;
+        }
+        DecodePostingBlock(block, postings.block_data_, ordinals.data(), term_counts.data(), document_lengths.data());
+        for (size_t j = 0; j < block.posting_count; ++j) {
+            if (!is_removed(ordinals[j])) {
+                Append(renumber(ordinals[j]), term_counts[j], document_lengths[j]);
+            }
+        }
+    }
+    for (size_t i = 0; i < postings.tail_size_; ++i) {
+        if (!is_removed(postings.tail_ordinals_[i])) {
+            Append(renumber(postings.tail_ordinals_[i]), postings.tail_term_counts_[i], postings.tail_document_lengths_[i]);
+        }
+    }
+}
+
+template <typename Function>
+void PostingListView::ForEach(Function function) const {
+    ForEachInRange(0, std::numeric_limits<DocumentOrdinal>::max(), function);
+}
+
+template <typename Function>
+void PostingListView::ForEachInRange(DocumentOrdinal begin, DocumentOrdinal end, Function function) const {
+    std::array<DocumentOrdinal, POSTING_BLOCK_SIZE> ordinals;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> term_counts;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> document_lengths;
+
+    const PostingBlock* const blocks_end = blocks_ + block_count_;
+    auto block_it = std::lower_bound(blocks_, blocks_end, begin,
+        [](const PostingBlock& block, DocumentOrdinal value) {
+            return block.last_ordinal < value;
+        });
+    for (; block_it != blocks_end && block_it->first_ordinal < end; ++block_it) {
+        DecodePostingBlock(*block_it, block_data_, ordinals.data(), term_counts.data(), document_lengths.data());
+        for (size_t i = 0; i < block_it->posting_count; ++i) {
+            if (ordinals[i] >= begin && ordinals[i] < end) {
+                function(ordinals[i], ComputeTermFreq(term_counts[i], document_lengths[i]));
+            }
+        }
+    }
+
+    const size_t tail_begin = std::lower_bound(tail_ordinals_, tail_ordinals_ + tail_size_, begin) - tail_ordinals_;
+    for (size_t i = tail_begin; i < tail_size_ && tail_ordinals_[i] < end; ++i) {
+        function(tail_ordinals_[i], ComputeTermFreq(tail_term_counts_[i], tail_document_lengths_[i]));
+    }
+}
@@ -1,23 +1,112 @@
 #include "process_queries.h"
 
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Больше документов на запрос заранее не резервируется: при большом
+// max_count буфер пакета иначе рос бы как число запросов на max_count
+const size_t JOINED_SLOT_MAX_SIZE = 64;
+
+// Общий пул создаётся при первом вызове и живёт до конца программы
+QueryExecutor& GetSharedExecutor() {
+	static QueryExecutor executor;
+	return executor;
+}
+
+} // namespace
+
+JoinedDocuments::JoinedDocuments(std::vector<Document> documents, std::vector<size_t> offsets)
+	: documents_(std::move(documents))
+	, offsets_(std::move(offsets))
+{
+}
+
+const Document* JoinedDocuments::begin() const {
+	return documents_.data();
+}
+
+const Document* JoinedDocuments::end() const {
+	return documents_.data() + documents_.size();
+}
+
+size_t JoinedDocuments::size() const {
+	return documents_.size();
+}
+
+bool JoinedDocuments::empty() const {
+	return documents_.empty();
+}
+
+size_t JoinedDocuments::GetQueryCount() const {
+	return offsets_.empty() ? 0 : offsets_.size() - 1;
+}
+
+ArrayView<Document> JoinedDocuments::GetQueryDocuments(size_t query_index) const {
+	return { documents_.data() + offsets_[query_index], offsets_[query_index + 1] - offsets_[query_index] };
+}
+
 std::vector<std::vector<Document>> ProcessQueries
 (const SearchServer& search_server, const std::vector<std::string>& queries) {
+	return ProcessQueries(GetSharedExecutor(), search_server, queries);
+}
+
+std::vector<std::vector<Document>> ProcessQueries
+(QueryExecutor& executor, const SearchServer& search_server, const std::vector<std::string>& queries) {
 	std::vector<std::vector<Document>> result(queries.size());
 
-	std::transform(std::execution::par,queries.begin(), queries.end(), result.begin(), [&search_server]
-	(const std::string& query) {return search_server.FindTopDocuments(query); });
+	ProcessQueriesStreamed(executor, search_server, queries, [&result](size_t index, std::vector<Document> documents) {
+		result[index] = std::move(documents);
+	});
 
 	return result;
 }
 
-std::list<Document>ProcessQueriesJoined
+void ProcessQueriesStreamed(QueryExecutor& executor, const SearchServer& search_server,
+	const std::vector<std::string>& queries, const std::function<void(size_t, std::vector<Document>)>& consumer) {
+	executor.ForEachIndex(queries.size(), [&](size_t index) {
+		consumer(index, search_server.FindTopDocuments(queries[index]));
+	});
+}
+
+std::list<Document> ProcessQueriesJoined
 (const SearchServer& search_server, const std::vector<std::string>& queries) {
+	const JoinedDocuments documents = ProcessQueriesJoined(GetSharedExecutor(), search_server, queries);
+	return { documents.begin(), documents.end() };
+}
+
+// Каждый запрос пишет результат сразу в свой участок общего буфера, а потом
+// участки сдвигаются вплотную. Результат, не уместившийся в участок (из-за
+// ограничения его размера или потому, что индекс успел вырасти), хранится
+// отдельно.
+JoinedDocuments ProcessQueriesJoined
+(QueryExecutor& executor, const SearchServer& search_server, const std::vector<std::string>& queries, size_t max_count) {
+	const size_t slot_size = std::min({ max_count, static_cast<size_t>(search_server.GetDocumentCount()), JOINED_SLOT_MAX_SIZE });
+	std::vector<Document> slots(queries.size() * slot_size);
+	std::vector<std::vector<Document>> oversized(queries.size());
+	std::vector<size_t> offsets(queries.size() + 1, 0);
 
-	std::list<Document> documents;
+	executor.ForEachIndex(queries.size(), [&](size_t index) {
+		std::vector<Document> result = search_server.FindTopDocuments(queries[index], DocumentStatus::ACTUAL, max_count);
+		offsets[index + 1] = result.size();
+		if (result.size() <= slot_size) {
+			std::copy(result.begin(), result.end(), slots.begin() + index * slot_size);
+		}
+		else {
+			oversized[index] = std::move(result);
+		}
+	});
 
-	for (const std::vector<Document> result_query : ProcessQueries(search_server,queries)) {
-		documents.insert(documents.end(),result_query.begin(),result_query.end());
+	for (size_t index = 0; index < queries.size(); ++index) {
+		offsets[index + 1] += offsets[index];
+	}
+	std::vector<Document> documents;
+	documents.reserve(offsets.back());
+	for (size_t index = 0; index < queries.size(); ++index) {
+		const Document* source = oversized[index].empty() ? slots.data() + index * slot_size : oversized[index].data();
+		documents.insert(documents.end(), source, source + (offsets[index + 1] - offsets[index]));
 	}
 
-	return documents;
+	return { std::move(documents), std::move(offsets) };
 }
\ No newline at end of file
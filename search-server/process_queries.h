@@ -1,13 +1,63 @@
 #pragma once
 
 #include "search_server.h"
+#include "query_executor.h"
+#include "array_view.h"
 
+#include <functional>
 #include <list>
 
+// Результаты пакета запросов подряд в одном буфере. Документы запроса index
+// лежат в [offsets[index], offsets[index + 1]).
+class JoinedDocuments {
+public:
+    JoinedDocuments() = default;
+
+    JoinedDocuments(std::vector<Document> documents, std::vector<size_t> offsets);
+
+    const Document* begin() const;
+
+    const Document* end() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    size_t GetQueryCount() const;
+
+    ArrayView<Document> GetQueryDocuments(size_t query_index) const;
+
+private:
+    std::vector<Document> documents_;
+    std::vector<size_t> offsets_;
+};
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
-std::list<Document>ProcessQueriesJoined(
+// Выполняет запросы на заданном пуле потоков
+std::vector<std::vector<Document>> ProcessQueries(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// Передаёт consumer(index, documents) результат каждого запроса, как только
+// он готов, не дожидаясь остальных. Вызовы идут из потоков пула
+// одновременно и в произвольном порядке.
+void ProcessQueriesStreamed(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    const std::function<void(size_t, std::vector<Document>)>& consumer);
+
+std::list<Document> ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// Результаты всех запросов одним буфером, до max_count документов на запрос
+JoinedDocuments ProcessQueriesJoined(
+    QueryExecutor& executor,
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+    const std::vector<std::string>& queries,
+    size_t max_count = MAX_RESULT_DOCUMENT_COUNT);
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "query_cache.h"
+
+#include <functional>
+
+QueryCache::QueryCache(size_t capacity)
+    : shards_(std::make_unique<Shard[]>(SHARD_COUNT))
+{
+    SetCapacity(capacity);
+}
+
+void QueryCache::SetCapacity(size_t capacity) {
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        Shard& shard = shards_[i];
+        std::lock_guard guard(shard.mutex);
+        shard.capacity = (capacity + SHARD_COUNT - 1) / SHARD_COUNT;
+        shard.index.clear();
+        shard.entries.clear();
+    }
+    enabled_.store(capacity > 0, std::memory_order_relaxed);
+}
+
+bool QueryCache::IsEnabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+}
+
+std::optional<std::vector<Document>> QueryCache::Find(const std::string& key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end() || it->second->generation != generation) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return it->second->documents;
+}
+
+// Результат, посчитанный на более старой версии индекса, чем уже
+// закешированный, не заменяет его
+void QueryCache::Insert(std::string key, uint64_t generation, std::vector<Document> documents) {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    if (shard.capacity == 0) {
+        return;
+    }
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        if (it->second->generation <= generation) {
+            it->second->generation = generation;
+            it->second->documents = std::move(documents);
+        }
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+
+    if (shard.entries.size() == shard.capacity) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({ std::move(key), generation, std::move(documents) });
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+}
+
+QueryCacheStats QueryCache::GetStats() const {
+    return { hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed) };
+}
+
+QueryCache::Shard& QueryCache::GetShard(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % SHARD_COUNT];
+}
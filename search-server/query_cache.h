@@ -0,0 +1,69 @@
+#pragma once
+
+#include "document.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct QueryCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+// Кеш результатов запросов, вытесняющий давно не использованные записи.
+// Запись помечена поколением индекса, на котором она посчитана, и при
+// поиске с другим поколением считается устаревшей. Ключи распределены по
+// сегментам, у каждого своя блокировка и своя доля ёмкости, поэтому кеш
+// можно одновременно использовать из многих потоков. Нулевая ёмкость
+// отключает кеш.
+class QueryCache {
+public:
+    explicit QueryCache(size_t capacity = 0);
+
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    // Меняет ёмкость, очищая кеш
+    void SetCapacity(size_t capacity);
+
+    bool IsEnabled() const;
+
+    std::optional<std::vector<Document>> Find(const std::string& key, uint64_t generation);
+
+    void Insert(std::string key, uint64_t generation, std::vector<Document> documents);
+
+    QueryCacheStats GetStats() const;
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Entry {
+        std::string key;
+        uint64_t generation = 0;
+        std::vector<Document> documents;
+    };
+
+    // Записи упорядочены от недавно использованных к давним
+    struct Shard {
+        std::mutex mutex;
+        size_t capacity = 0;
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    std::atomic<bool> enabled_{ false };
+    std::atomic<uint64_t> hits_{ 0 };
+    std::atomic<uint64_t> misses_{ 0 };
+
+    Shard& GetShard(const std::string& key);
+};
@@ -0,0 +1,28 @@
+#include "query_deadline.h"
+
+QueryDeadline::QueryDeadline(Clock::time_point time)
+    : time_(time)
+{
+}
+
+QueryDeadline QueryDeadline::After(Clock::duration timeout) {
+    return QueryDeadline(Clock::now() + timeout);
+}
+
+bool QueryDeadline::IsSet() const {
+    return time_ != Clock::time_point::max();
+}
+
+QueryDeadline::Clock::time_point QueryDeadline::GetTime() const {
+    return time_;
+}
+
+bool QueryDeadline::IsExpired() const {
+    return IsSet() && Clock::now() >= time_;
+}
+
+void QueryDeadline::Check() const {
+    if (IsExpired()) {
+        throw QueryDeadlineExceeded("Истёк срок выполнения запроса");
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+
+const size_t QUERY_DEADLINE_CHECK_INTERVAL = 1024;
+
+class QueryDeadlineExceeded : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Срок, до которого запрос должен выполниться. Срок по умолчанию не наступает
+// никогда.
+class QueryDeadline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    QueryDeadline() = default;
+
+    explicit QueryDeadline(Clock::time_point time);
+
+    static QueryDeadline After(Clock::duration timeout);
+
+    bool IsSet() const;
+
+    Clock::time_point GetTime() const;
+
+    bool IsExpired() const;
+
+    // Бросает QueryDeadlineExceeded, если срок наступил
+    void Check() const;
+
+private:
+    Clock::time_point time_ = Clock::time_point::max();
+};
+
+// Проверка срока внутри обхода списков вхождений: часы опрашиваются раз в
+// QUERY_DEADLINE_CHECK_INTERVAL вызовов Poll, а без срока не опрашиваются
+// совсем. Заводится один на запрос (или на поток, обходящий часть запроса),
+// чтобы отсчёт не начинался заново в каждом сегменте.
+class QueryDeadlineChecker {
+public:
+    explicit QueryDeadlineChecker(const QueryDeadline& deadline)
+        : deadline_(deadline)
+        , countdown_(deadline.IsSet() ? QUERY_DEADLINE_CHECK_INTERVAL : std::numeric_limits<size_t>::max())
+    {
+    }
+
+    void Poll() {
+        if (--countdown_ == 0) {
+            countdown_ = QUERY_DEADLINE_CHECK_INTERVAL;
+            deadline_.Check();
+        }
+    }
+
+private:
+    const QueryDeadline& deadline_;
+    size_t countdown_;
+};
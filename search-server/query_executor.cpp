@@ -0,0 +1,208 @@
+#include "query_executor.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+
+void PinCurrentThread(size_t index) {
+    DWORD_PTR process_mask = 0;
+    DWORD_PTR system_mask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask) || process_mask == 0) {
+        return;
+    }
+    std::vector<DWORD_PTR> cpus;
+    for (size_t cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu) {
+        if (process_mask & (DWORD_PTR{ 1 } << cpu)) {
+            cpus.push_back(DWORD_PTR{ 1 } << cpu);
+        }
+    }
+    SetThreadAffinityMask(GetCurrentThread(), cpus[index % cpus.size()]);
+}
+
+#elif defined(__linux__)
+
+void PinCurrentThread(size_t index) {
+    cpu_set_t process_set;
+    CPU_ZERO(&process_set);
+    if (sched_getaffinity(0, sizeof(process_set), &process_set) != 0 || CPU_COUNT(&process_set) == 0) {
+        return;
+    }
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &process_set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    cpu_set_t thread_set;
+    CPU_ZERO(&thread_set);
+    CPU_SET(cpus[index % cpus.size()], &thread_set);
+    pthread_setaffinity_np(pthread_self(), sizeof(thread_set), &thread_set);
+}
+
+#else
+
+void PinCurrentThread(size_t) {
+}
+
+#endif
+
+}  // namespace
+
+QueryExecutor::QueryExecutor(size_t thread_count, bool pin_workers) {
+    for (size_t worker = 0; worker + 1 < std::max<size_t>(thread_count, 1); ++worker) {
+        workers_.emplace_back([this, worker, pin_workers] {
+            if (pin_workers) {
+                PinCurrentThread(worker);
+            }
+            RunWorker(worker);
+            });
+    }
+}
+
+QueryExecutor::~QueryExecutor() {
+    {
+        std::lock_guard lock(state_mutex_);
+        stopping_ = true;
+    }
+    batch_started_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t QueryExecutor::GetThreadCount() const {
+    return workers_.size() + 1;
+}
+
+// Рабочий поток с номером worker занимает в пакете диапазон с тем же
+// номером, вызывающий поток — последний
+void QueryExecutor::ForEachIndex(size_t count, const std::function<void(size_t)>& function) {
+    if (count == 0) {
+        return;
+    }
+    const size_t thread_count = GetThreadCount();
+    Batch batch;
+    batch.function = &function;
+    batch.ranges = std::make_unique<WorkRange[]>(thread_count);
+    for (size_t slot = 0; slot < thread_count; ++slot) {
+        batch.ranges[slot].begin = slot * count / thread_count;
+        batch.ranges[slot].end = (slot + 1) * count / thread_count;
+    }
+    {
+        std::lock_guard lock(state_mutex_);
+        batches_.push_back(&batch);
+    }
+    batch_started_.notify_all();
+
+    ProcessBatch(batch, workers_.size());
+
+    {
+        std::unique_lock lock(state_mutex_);
+        batch.exhausted = true;
+        batch_finished_.wait(lock, [&batch] {
+            return batch.participant_count == 0;
+            });
+        batches_.erase(std::find(batches_.begin(), batches_.end(), &batch));
+    }
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+void QueryExecutor::RunWorker(size_t worker) {
+    while (true) {
+        Batch* batch = nullptr;
+        {
+            std::unique_lock lock(state_mutex_);
+            batch_started_.wait(lock, [this, &batch] {
+                batch = FindOpenBatch();
+                return stopping_ || batch != nullptr;
+                });
+            if (stopping_) {
+                return;
+            }
+            ++batch->participant_count;
+        }
+
+        ProcessBatch(*batch, worker);
+
+        std::lock_guard lock(state_mutex_);
+        batch->exhausted = true;
+        if (--batch->participant_count == 0) {
+            batch_finished_.notify_all();
+        }
+    }
+}
+
+QueryExecutor::Batch* QueryExecutor::FindOpenBatch() const {
+    const auto it = std::find_if(batches_.begin(), batches_.end(), [](const Batch* batch) {
+        return !batch->exhausted;
+        });
+    return it == batches_.end() ? nullptr : *it;
+}
+
+void QueryExecutor::ProcessBatch(Batch& batch, size_t slot) {
+    size_t index = 0;
+    while (TakeIndex(batch, slot, index)) {
+        try {
+            (*batch.function)(index);
+        }
+        catch (...) {
+            std::lock_guard lock(batch.error_mutex);
+            if (!batch.error) {
+                batch.error = std::current_exception();
+            }
+            batch.failed.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Диапазоны только сужаются, поэтому, если задач не нашлось ни в одном,
+// их не появится и позже. После ошибки оставшиеся задачи отбрасываются.
+bool QueryExecutor::TakeIndex(Batch& batch, size_t slot, size_t& index) {
+    if (batch.failed.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    WorkRange& own = batch.ranges[slot];
+    {
+        std::lock_guard lock(own.mutex);
+        if (own.begin < own.end) {
+            index = own.begin++;
+            return true;
+        }
+    }
+
+    const size_t thread_count = GetThreadCount();
+    for (size_t step = 1; step < thread_count; ++step) {
+        WorkRange& victim = batch.ranges[(slot + step) % thread_count];
+        size_t begin = 0;
+        size_t end = 0;
+        {
+            std::lock_guard lock(victim.mutex);
+            if (victim.begin == victim.end) {
+                continue;
+            }
+            // Забирается старшая половина, последняя задача — целиком
+            begin = victim.begin + (victim.end - victim.begin) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+        std::lock_guard lock(own.mutex);
+        own.begin = begin + 1;
+        own.end = end;
+        index = begin;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков для пакетов независимых задач, например запросов. Каждый
+// участник пакета (рабочие потоки и поток, вызвавший ForEachIndex) получает
+// свой непрерывный диапазон индексов и берёт задачи с его начала. Закончив
+// свой диапазон, участник забирает половину оставшегося у другого, поэтому
+// несколько долгих задач не задерживают остальные.
+//
+// Пакеты из разных потоков выполняются одновременно: вызвавший поток всегда
+// работает над своим пакетом, а освободившийся рабочий поток присоединяется
+// к самому старому пакету, в котором ещё остались задачи. Поэтому
+// ForEachIndex можно вызывать и из задачи этого же пула. Рабочие потоки
+// живут всё время жизни пула, и их thread_local-буферы (например, контексты
+// запросов SearchServer) переиспользуются от пакета к пакету.
+//
+// С pin_workers рабочий поток с номером worker закрепляется за worker-м по
+// счёту доступным процессу ядром (по кругу), чтобы его буферы оставались в
+// кеше этого ядра. Закрепление делается в Windows и Linux; где оно не
+// поддерживается или не удалось, потоки остаются незакреплёнными.
+class QueryExecutor {
+public:
+    explicit QueryExecutor(size_t thread_count = std::thread::hardware_concurrency(), bool pin_workers = false);
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    ~QueryExecutor();
+
+    // Число участников пакета, включая вызывающий поток
+    size_t GetThreadCount() const;
+
+    // Вызывает function(index) для всех index из [0, count) и ждёт окончания.
+    // Первое исключение из function прерывает пакет и пробрасывается дальше.
+    void ForEachIndex(size_t count, const std::function<void(size_t)>& function);
+
+private:
+    struct alignas(64) WorkRange {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    struct Batch {
+        const std::function<void(size_t)>* function = nullptr;
+        std::unique_ptr<WorkRange[]> ranges;
+        std::atomic<bool> failed{ false };
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        // Поля ниже защищены state_mutex_
+        size_t participant_count = 0;
+        bool exhausted = false;
+    };
+
+    std::vector<std::thread> workers_;
+
+    std::mutex state_mutex_;
+    std::condition_variable batch_started_;
+    std::condition_variable batch_finished_;
+    std::vector<Batch*> batches_;
+    bool stopping_ = false;
+
+    void RunWorker(size_t worker);
+
+    Batch* FindOpenBatch() const;
+
+    void ProcessBatch(Batch& batch, size_t slot);
+
+    bool TakeIndex(Batch& batch, size_t slot, size_t& index);
+};
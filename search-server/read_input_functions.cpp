@@ -1,5 +1,43 @@
 #include "read_input_functions.h"
 
+#include <algorithm>
+#include <charconv>
+#include <execution>
+#include <future>
+#include <stdexcept>
+
+namespace {
+
+std::string_view NextField(std::string_view& line, char separator) {
+    const size_t end = line.find(separator);
+    const std::string_view field = line.substr(0, end);
+    line.remove_prefix(end == std::string_view::npos ? line.size() : end + 1);
+    return field;
+}
+
+bool ParseInt(std::string_view text, int& value) {
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size();
+}
+
+bool ParseStatus(std::string_view text, DocumentStatus& status) {
+    static const std::pair<std::string_view, DocumentStatus> STATUS_NAMES[] = {
+        { "ACTUAL", DocumentStatus::ACTUAL },
+        { "IRRELEVANT", DocumentStatus::IRRELEVANT },
+        { "BANNED", DocumentStatus::BANNED },
+        { "REMOVED", DocumentStatus::REMOVED },
+    };
+    for (const auto& [name, value] : STATUS_NAMES) {
+        if (name == text) {
+            status = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
 std::string ReadLine() {
     std::string words;
     std::getline(std::cin, words);
@@ -11,4 +49,65 @@ int ReadLineWithNumber() {
     std::cin >> result;
     ReadLine();
     return result;
-}
\ No newline at end of file
+}
+
+CorpusReader::CorpusReader(const std::string& path)
+    : file_(std::make_shared<const MappedFile>(path))
+    , rest_(file_->data(), file_->size())
+{
+}
+
+std::vector<NewDocument> CorpusReader::ReadBatch(size_t max_count) {
+    std::vector<NewDocument> batch;
+    while (batch.size() < max_count && !rest_.empty()) {
+        std::string_view line = NextField(rest_, '\n');
+        ++line_number_;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (!line.empty()) {
+            batch.push_back(ParseRecord(line));
+        }
+    }
+    return batch;
+}
+
+NewDocument CorpusReader::ParseRecord(std::string_view line) const {
+    const auto fail = [this]() {
+        return std::invalid_argument("Ошибка в строке " + std::to_string(line_number_) + " корпуса");
+    };
+
+    NewDocument document;
+    if (std::count(line.begin(), line.end(), '\t') < 3) {
+        throw fail();
+    }
+    if (!ParseInt(NextField(line, '\t'), document.id) || !ParseStatus(NextField(line, '\t'), document.status)) {
+        throw fail();
+    }
+    std::string_view ratings = NextField(line, '\t');
+    while (!ratings.empty()) {
+        const std::string_view rating = NextField(ratings, ' ');
+        if (rating.empty()) {
+            continue;
+        }
+        if (!ParseInt(rating, document.ratings.emplace_back())) {
+            throw fail();
+        }
+    }
+    document.text = line;
+    return document;
+}
+
+void LoadCorpus(SearchServer& search_server, const std::string& path, size_t batch_size) {
+    CorpusReader reader(path);
+    const auto read_batch = [&reader, batch_size]() {
+        return reader.ReadBatch(batch_size);
+    };
+
+    std::vector<NewDocument> batch = read_batch();
+    while (!batch.empty()) {
+        auto next_batch = std::async(std::launch::async, read_batch);
+        search_server.AddDocuments(std::execution::par, batch);
+        batch = next_batch.get();
+    }
+}
@@ -1,7 +1,43 @@
 #pragma once
+#include "document.h"
+#include "index_file.h"
+#include "search_server.h"
+
 #include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+
+const size_t CORPUS_BATCH_SIZE = 4096;
 
 std::string ReadLine();
 
-int ReadLineWithNumber();
\ No newline at end of file
+int ReadLineWithNumber();
+
+// Читает корпус из отображённого в память файла. Каждая непустая строка —
+// один документ из четырёх полей через табуляцию:
+//     id<TAB>статус<TAB>рейтинги через пробел<TAB>текст
+// Статус записывается именем (ACTUAL, IRRELEVANT, BANNED, REMOVED).
+// Тексты документов — string_view прямо в отображённый файл, поэтому
+// они живут, пока жив читатель.
+class CorpusReader {
+public:
+    explicit CorpusReader(const std::string& path);
+
+    // Следующие не более max_count документов; пустой пакет — конец корпуса
+    std::vector<NewDocument> ReadBatch(size_t max_count);
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    std::string_view rest_;
+    size_t line_number_ = 0;
+
+    NewDocument ParseRecord(std::string_view line) const;
+};
+
+// Добавляет корпус в сервер пакетами через AddDocuments. Следующий пакет
+// разбирается в фоне, пока индексируется текущий, так что подкачка страниц
+// файла идёт параллельно с индексацией. При ошибке разбора или добавления
+// пакеты до ошибочного остаются в сервере.
+void LoadCorpus(SearchServer& search_server, const std::string& path, size_t batch_size = CORPUS_BATCH_SIZE);
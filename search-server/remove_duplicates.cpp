@@ -5,11 +5,12 @@ void RemoveDuplicates(SearchServer& search_server) {
 	std::vector<int> duplicate_ids;
 
 	for (const int document_id : search_server) {
-		auto word_freqs = search_server.GetWordFrequencies(document_id);
-		std::vector<std::string> words(word_freqs.size());
+		const auto word_freqs = search_server.GetWordFrequencies(document_id);
+		std::vector<std::string> words;
+		words.reserve(word_freqs.size());
 		std::transform(word_freqs.cbegin(), word_freqs.cend(),
-			std::inserter(words, words.begin()), [](const std::pair<std::string, double>& elements) {
-				return elements.first;
+			std::back_inserter(words), [](const auto& elements) {
+				return std::string(elements.first);
 			});
 
 		auto [word, emplaced] = doc_words.emplace(words, document_id);
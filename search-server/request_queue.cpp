@@ -1,44 +1,92 @@
 #include "request_queue.h"
 
-RequestQueue::RequestQueue(const SearchServer& search_server) 
-    : server(search_server), empty_result(0), time(0) {
-}
-
-#include "request_queue.h"
+#include <algorithm>
+#include <thread>
 
+RequestQueue::RequestQueue(const SearchServer& search_server, Clock::duration window)
+    : search_server_(search_server)
+    , start_(Clock::now())
+    , bucket_duration_(std::max<Clock::duration>(window / REQUEST_WINDOW_BUCKET_COUNT, Clock::duration(1)))
+    , buckets_(std::make_unique<WindowBucket[]>(REQUEST_WINDOW_BUCKET_COUNT))
+{
+}
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    const auto result = server.FindTopDocuments(raw_query, status);
-    Add_Query_Result(static_cast<int>(result.size()));
+    const auto start = Clock::now();
+    const auto result = search_server_.FindTopDocuments(raw_query, status);
+    AddQueryResult(result.size(), start, Clock::now());
     return result;
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
-    const auto result = server.FindTopDocuments(raw_query);
-    Add_Query_Result(static_cast<int>(result.size()));
+    const auto start = Clock::now();
+    const auto result = search_server_.FindTopDocuments(raw_query);
+    AddQueryResult(result.size(), start, Clock::now());
     return result;
 }
 
 int RequestQueue::GetNoResultRequests() const {
-    return empty_result;
+    uint64_t no_result_count = 0;
+    ForEachBucketInWindow([&no_result_count](const WindowBucket& bucket) {
+        no_result_count += bucket.no_result_count.load(std::memory_order_relaxed);
+        });
+    return static_cast<int>(no_result_count);
 }
 
-void RequestQueue::Add_Query_Result(const size_t& result_search_Size) {
+// Частота запросов считается по прошедшей части окна, пока окно не заполнилось
+RequestStats RequestQueue::GetStats() const {
+    RequestStats stats;
+    LatencyHistogram latencies;
+    ForEachBucketInWindow([&](const WindowBucket& bucket) {
+        stats.request_count += bucket.request_count.load(std::memory_order_relaxed);
+        stats.no_result_count += bucket.no_result_count.load(std::memory_order_relaxed);
+        latencies.Merge(bucket.latencies);
+        });
 
-    ++time;
+    const Clock::duration window = bucket_duration_ * REQUEST_WINDOW_BUCKET_COUNT;
+    const Clock::duration elapsed = std::min(window, Clock::now() - start_);
+    if (elapsed > Clock::duration::zero()) {
+        stats.requests_per_second = stats.request_count / std::chrono::duration<double>(elapsed).count();
+    }
+    stats.latency_p50 = latencies.GetPercentile(50.0);
+    stats.latency_p90 = latencies.GetPercentile(90.0);
+    stats.latency_p99 = latencies.GetPercentile(99.0);
+    stats.latency_p999 = latencies.GetPercentile(99.9);
+    return stats;
+}
 
-    if (time > min_in_day_) {
-        while (requests_.size() >= min_in_day_) {
-            if (requests_.front().result_search == 0) {
-                --empty_result;
-            }
-            requests_.pop_front();
-        }
+void RequestQueue::AddQueryResult(size_t result_count, Clock::time_point start, Clock::time_point finish) {
+    WindowBucket& bucket = AcquireBucket(GetInterval(finish));
+    bucket.request_count.fetch_add(1, std::memory_order_relaxed);
+    if (result_count == 0) {
+        bucket.no_result_count.fetch_add(1, std::memory_order_relaxed);
     }
+    bucket.latencies.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start));
+}
 
-    requests_.push_back({ static_cast<int>(result_search_Size) });
+uint64_t RequestQueue::GetInterval(Clock::time_point time) const {
+    return static_cast<uint64_t>((time - start_) / bucket_duration_);
+}
 
-    if (result_search_Size == 0) {
-        ++empty_result;
+// Устаревший интервал обнуляет поток, которому удалось пометить его как
+// обнуляемый; остальные ждут окончания. Поток, отставший больше чем на окно,
+// пишет в более новый интервал, который уже занял его место.
+RequestQueue::WindowBucket& RequestQueue::AcquireBucket(uint64_t interval) {
+    WindowBucket& bucket = buckets_[interval % REQUEST_WINDOW_BUCKET_COUNT];
+    const uint64_t new_stamp = interval + 1;
+    uint64_t stamp = bucket.stamp.load(std::memory_order_acquire);
+    while (stamp < new_stamp || stamp == RESETTING_STAMP) {
+        if (stamp == RESETTING_STAMP) {
+            std::this_thread::yield();
+            stamp = bucket.stamp.load(std::memory_order_acquire);
+        }
+        else if (bucket.stamp.compare_exchange_weak(stamp, RESETTING_STAMP, std::memory_order_acquire)) {
+            bucket.request_count.store(0, std::memory_order_relaxed);
+            bucket.no_result_count.store(0, std::memory_order_relaxed);
+            bucket.latencies.Clear();
+            bucket.stamp.store(new_stamp, std::memory_order_release);
+            break;
+        }
     }
-}
\ No newline at end of file
+    return bucket;
+}
@@ -2,15 +2,40 @@
 
 #include "document.h"
 #include "search_server.h"
+#include "latency_histogram.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
-#include <deque>
 
+const size_t REQUEST_WINDOW_BUCKET_COUNT = 60;
+
+struct RequestStats {
+    uint64_t request_count = 0;
+    uint64_t no_result_count = 0;
+    double requests_per_second = 0.0;
+    std::chrono::nanoseconds latency_p50{ 0 };
+    std::chrono::nanoseconds latency_p90{ 0 };
+    std::chrono::nanoseconds latency_p99{ 0 };
+    std::chrono::nanoseconds latency_p999{ 0 };
+};
+
+// Статистика запросов за последний промежуток времени window. Окно разбито
+// на REQUEST_WINDOW_BUCKET_COUNT интервалов, лежащих в кольцевом буфере:
+// запрос учитывается атомарными счётчиками текущего интервала, а интервал,
+// вышедший из окна, обнуляется первым попавшим в него новым запросом.
+// Запросы можно добавлять и статистику читать из многих потоков без
+// блокировок. Счёт приблизительный: запрос, пришедший во время обнуления
+// интервала, может быть учтён в новом интервале или потерян.
+// Каждый интервал занимает около 5 КБ (счётчики гистограммы задержек), учёт
+// запроса стоит порядка 150 нс сверх самого поиска, включая чтение часов.
 class RequestQueue {
 public:
-
-    explicit RequestQueue(const SearchServer& search_server);
+    explicit RequestQueue(const SearchServer& search_server,
+        std::chrono::steady_clock::duration window = std::chrono::hours(24));
 
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
@@ -19,28 +44,62 @@ public:
 
     std::vector<Document> AddFindRequest(const std::string& raw_query);
 
+    // Число запросов без результатов за окно, а не за последние 1440
+    // запросов. Окно сдвигается целыми интервалами длины
+    // window / REQUEST_WINDOW_BUCKET_COUNT (24 минуты для суток), поэтому
+    // запрос перестаёт учитываться через время от window минус интервал до
+    // window после него.
     int GetNoResultRequests() const;
 
+    RequestStats GetStats() const;
+
 private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint64_t RESETTING_STAMP = ~uint64_t{ 0 };
 
-    struct QueryResult {
-        int result_search;
+    struct alignas(64) WindowBucket {
+        // Номер интервала плюс один; 0 — интервал ещё не использовался
+        std::atomic<uint64_t> stamp{ 0 };
+        std::atomic<uint64_t> request_count{ 0 };
+        std::atomic<uint64_t> no_result_count{ 0 };
+        LatencyHistogram latencies;
     };
 
-    const SearchServer& server;
-    std::deque<QueryResult> requests_;
+    const SearchServer& search_server_;
+    const Clock::time_point start_;
+    const Clock::duration bucket_duration_;
+    std::unique_ptr<WindowBucket[]> buckets_;
 
-    const static int min_in_day_ = 1440;
+    void AddQueryResult(size_t result_count, Clock::time_point start, Clock::time_point finish);
 
-    int empty_result;
-    int time;
+    uint64_t GetInterval(Clock::time_point time) const;
 
-    void Add_Query_Result(const size_t& result_search_Size);
+    WindowBucket& AcquireBucket(uint64_t interval);
+
+    template <typename Function>
+    void ForEachBucketInWindow(Function function) const;
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-    auto result_search = server.FindTopDocuments(raw_query, document_predicate);
-    Add_Query_Result(result_search.size());
+    const auto start = Clock::now();
+    auto result_search = search_server_.FindTopDocuments(raw_query, document_predicate);
+    AddQueryResult(result_search.size(), start, Clock::now());
     return result_search;
-}
\ No newline at end of file
+}
+
+// Обнуляемые сейчас интервалы пропускаются
+template <typename Function>
+void RequestQueue::ForEachBucketInWindow(Function function) const {
+    const uint64_t current_stamp = GetInterval(Clock::now()) + 1;
+    for (size_t i = 0; i < REQUEST_WINDOW_BUCKET_COUNT; ++i) {
+        const WindowBucket& bucket = buckets_[i];
+        const uint64_t stamp = bucket.stamp.load(std::memory_order_acquire);
+        if (stamp == 0 || stamp == RESETTING_STAMP || stamp > current_stamp
+            || current_stamp - stamp >= REQUEST_WINDOW_BUCKET_COUNT) {
+            continue;
+        }
+        function(bucket);
+    }
+}
@@ -0,0 +1,14 @@
+#include "score_accumulator.h"
+
+void ScoreAccumulator::Reset(size_t ordinal_count) {
+    for (const DocumentOrdinal ordinal : touched_) {
+        relevances_[ordinal] = 0.0;
+        states_[ordinal] = State::UNTOUCHED;
+    }
+    touched_.clear();
+
+    if (relevances_.size() < ordinal_count) {
+        relevances_.resize(ordinal_count, 0.0);
+        states_.resize(ordinal_count, State::UNTOUCHED);
+    }
+}
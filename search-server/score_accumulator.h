@@ -0,0 +1,64 @@
+#pragma once
+
+#include "posting_block.h"
+
+#include <cstdint>
+#include <vector>
+
+// Плотный массив релевантностей, индексируемый внутренним номером документа.
+// Помимо суммы для каждого документа хранится его состояние: ещё не встречался,
+// набирает релевантность или отброшен (минус-слово или фильтр). Список
+// затронутых номеров позволяет очищать массив за время, пропорциональное
+// размеру результата, поэтому один экземпляр переиспользуется между запросами.
+class ScoreAccumulator {
+public:
+    enum class State : uint8_t {
+        UNTOUCHED,
+        SCORED,
+        EXCLUDED
+    };
+
+    void Reset(size_t ordinal_count);
+
+    State GetState(DocumentOrdinal ordinal) const;
+
+    void Exclude(DocumentOrdinal ordinal);
+
+    void Add(DocumentOrdinal ordinal, double relevance);
+
+    template <typename Function>
+    void ForEachScored(Function function) const;
+
+private:
+    std::vector<double> relevances_;
+    std::vector<State> states_;
+    std::vector<DocumentOrdinal> touched_;
+};
+
+inline ScoreAccumulator::State ScoreAccumulator::GetState(DocumentOrdinal ordinal) const {
+    return states_[ordinal];
+}
+
+inline void ScoreAccumulator::Exclude(DocumentOrdinal ordinal) {
+    if (states_[ordinal] == State::UNTOUCHED) {
+        touched_.push_back(ordinal);
+    }
+    states_[ordinal] = State::EXCLUDED;
+}
+
+inline void ScoreAccumulator::Add(DocumentOrdinal ordinal, double relevance) {
+    if (states_[ordinal] == State::UNTOUCHED) {
+        touched_.push_back(ordinal);
+        states_[ordinal] = State::SCORED;
+    }
+    relevances_[ordinal] += relevance;
+}
+
+template <typename Function>
+void ScoreAccumulator::ForEachScored(Function function) const {
+    for (const DocumentOrdinal ordinal : touched_) {
+        if (states_[ordinal] == State::SCORED) {
+            function(ordinal, relevances_[ordinal]);
+        }
+    }
+}
@@ -1,141 +1,357 @@
 #include "search_server.h"
 
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
-    if (document_id < 0) {
-        throw std::invalid_argument("Попытка добавить документ с отрицательным id!");
+    std::lock_guard lock(write_mutex_);
+    CheckNewDocumentId(document_id);
+    const TokenizedDocument tokens = TokenizeDocument(document);
+
+    std::vector<std::pair<TermId, uint32_t>> term_counts;
+    term_counts.reserve(tokens.word_counts.size());
+    for (const auto& [word, term_count] : tokens.word_counts) {
+        term_counts.emplace_back(terms_.Intern(word), term_count);
     }
+    std::sort(term_counts.begin(), term_counts.end());
 
-    if (documents_.count(document_id)) {
-        throw std::invalid_argument("Попытка добавить документ c id ранее добавленного документа!");
+    if (head_ && !head_->CanAdd(document.size(), term_counts.size())) {
+        SealHeadSegment();
+    }
+    const DocumentOrdinal ordinal = next_ordinal_;
+    if (!head_ && document.size() <= HEAD_SEGMENT_MAX_TEXT_SIZE && term_counts.size() <= HEAD_SEGMENT_MAX_POSTINGS) {
+        head_ = std::make_shared<HeadSegment>(ordinal, HEAD_SEGMENT_MAX_DOCUMENTS, HEAD_SEGMENT_MAX_POSTINGS, HEAD_SEGMENT_MAX_TEXT_SIZE);
+    }
+    if (head_) {
+        head_->AddDocument(document_id, ComputeAverageRating(ratings), status, document, term_counts, tokens.length);
+        ++document_count_;
+        ++next_ordinal_;
+        MergeSegments();
+        PublishVersion();
+        return;
     }
 
-    if (!IsValidWord(document)) {
-        throw std::invalid_argument("Наличие недопустимых символов!");
+    // Документ, который не поместился бы и в пустую голову, сразу становится
+    // отдельным сегментом
+    std::vector<WordFreq> word_freqs;
+    word_freqs.reserve(term_counts.size());
+    for (const auto& [term_id, term_count] : term_counts) {
+        word_freqs.emplace_back(term_id, ComputeTermFreq(term_count, tokens.length));
     }
 
-    auto words = SplitIntoWordsNoStop(document);
+    IndexSegment segment(ordinal);
+    segment.AddDocument(document_id, ComputeAverageRating(ratings), status, document,
+        { word_freqs.data(), word_freqs.data() + word_freqs.size() });
+    for (const auto& [term_id, term_count] : term_counts) {
+        segment.AddPosting(term_id, ordinal, term_count, tokens.length);
+    }
+    segment.Seal();
 
-    const std::string document_string{ document };
+    GetMutableDocumentOrdinals().Set(document_id, ordinal);
+    ++document_count_;
+    ++next_ordinal_;
+    AddSegment(std::move(segment));
+}
 
-    documents_.emplace(document_id, DocumentData{ SearchServer::ComputeAverageRating(ratings), status, document_string });
+SearchServer SearchServer::Open(const std::string& path) {
+    return SearchServer(IndexFileReader(std::make_shared<const MappedFile>(path)));
+}
 
-    words = SplitIntoWordsNoStop(documents_.at(document_id).string);
+// Файл индекса: стоп-слова, слова словаря по порядку TermId, следующий
+// свободный номер документа и сегменты. Снимок головы и сегменты с
+// удалёнными документами перед записью сливаются в обычные сегменты без них.
+// Словарь в памяти не освобождает слова, которых больше нет ни в одном
+// документе, поэтому в файл пишутся только слова неудалённых документов, а
+// их TermId сдвигаются вплотную с сохранением порядка.
+void SearchServer::Save(const std::string& path) const {
+    const auto version = LoadVersion();
+    std::ofstream output(path, std::ios::binary);
+    if (!output) {
+        throw std::runtime_error("Не удалось создать файл индекса " + path);
+    }
 
-    for (auto word : words) {
+    const size_t term_count = terms_.GetTermCount();
+    std::vector<bool> used_terms(term_count);
+    for (const auto& segment : version->segments) {
+        for (DocumentOrdinal ordinal = segment->GetFirstOrdinal(); ordinal < segment->GetEndOrdinal(); ++ordinal) {
+            if (version->removed->IsRemoved(ordinal) || segment->GetDocumentId(ordinal) < 0) {
+                continue;
+            }
+            for (const auto& [term_id, term_freq] : segment->GetWordFreqs(ordinal)) {
+                used_terms[term_id] = true;
+            }
+        }
+    }
+    std::vector<TermId> new_term_ids(term_count);
+    std::vector<std::string_view> terms;
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        new_term_ids[term_id] = static_cast<TermId>(terms.size());
+        if (used_terms[term_id]) {
+            terms.push_back(terms_.GetTerm(term_id));
+        }
+    }
+
+    IndexFileWriter writer(output);
+    WriteStrings(writer, stop_words_);
+    WriteStrings(writer, terms);
+
+    writer.WriteValue(version->next_ordinal);
+    writer.WriteValue(version->segments.size());
+    for (const auto& segment : version->segments) {
+        const auto removed_ordinals = CollectRemovedOrdinals(*version->removed, segment->GetFirstOrdinal(), segment->GetEndOrdinal());
+        if (!segment->IsHeadSnapshot() && std::find(removed_ordinals.begin(), removed_ordinals.end(), true) == removed_ordinals.end()) {
+            segment->Save(writer, new_term_ids);
+        }
+        else {
+            MergeIndexSegments({ segment }, removed_ordinals).Save(writer, new_term_ids);
+        }
+    }
+    output.close();
+    if (!output) {
+        throw std::runtime_error("Не удалось записать файл индекса " + path);
+    }
+}
 
-        word_to_document_freqs_[word][document_id] += 1.0 / words.size();
+SearchServer::SearchServer(IndexFileReader reader)
+    : removed_(std::make_shared<RemovedDocuments>())
+    , document_ordinals_(std::make_shared<DocumentOrdinals>())
+    , stop_words_(ReadStrings(reader))
+{
+    const auto term_chars = reader.ReadArray<char>();
+    const auto term_offsets = reader.ReadArray<uint64_t>();
+    for (size_t i = 0; i + 1 < term_offsets.size(); ++i) {
+        if (term_offsets[i] > term_offsets[i + 1] || term_offsets[i + 1] > term_chars.size()
+            || terms_.Intern(std::string_view(term_chars.data() + term_offsets[i], term_offsets[i + 1] - term_offsets[i])) != i) {
+            throw std::runtime_error("Файл индекса повреждён");
+        }
+    }
 
-        document_to_word_freqs_[document_id][word] += 1.0 / words.size();
+    next_ordinal_ = static_cast<DocumentOrdinal>(reader.ReadValue());
+    const uint64_t segment_count = reader.ReadValue();
+    DocumentOrdinal end_ordinal = 0;
+    for (uint64_t i = 0; i < segment_count; ++i) {
+        auto segment = std::make_shared<const IndexSegment>(reader, terms_.GetTermCount());
+        // Сегменты идут по возрастанию номеров и не выходят за next_ordinal_
+        if (segment->GetFirstOrdinal() < end_ordinal || segment->GetEndOrdinal() > next_ordinal_) {
+            throw std::runtime_error("Файл индекса повреждён");
+        }
+        end_ordinal = segment->GetEndOrdinal();
+        for (DocumentOrdinal ordinal = segment->GetFirstOrdinal(); ordinal < segment->GetEndOrdinal(); ++ordinal) {
+            if (segment->GetDocumentId(ordinal) >= 0) {
+                document_ordinals_->Set(segment->GetDocumentId(ordinal), ordinal);
+            }
+        }
+        const size_t level = ComputeSegmentLevel(*segment);
+        segments_.push_back({ std::move(segment), level });
+    }
+    document_count_ = document_ordinals_->size();
+    PublishVersion();
+}
 
+std::set<std::string, std::less<>> SearchServer::ReadStrings(IndexFileReader& reader) {
+    const auto chars = reader.ReadArray<char>();
+    const auto offsets = reader.ReadArray<uint64_t>();
+    std::set<std::string, std::less<>> strings;
+    for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > chars.size()) {
+            throw std::runtime_error("Файл индекса повреждён");
+        }
+        strings.emplace(chars.data() + offsets[i], offsets[i + 1] - offsets[i]);
     }
+    return strings;
+}
+
+void SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    AddDocuments(std::execution::seq, documents);
+}
 
-    document_ids_.emplace(document_id);
+void SearchServer::SetQueryCacheCapacity(size_t capacity) {
+    query_cache_.SetCapacity(capacity);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, raw_query, status);
+QueryCacheStats SearchServer::GetQueryCacheStats() const {
+    return query_cache_.GetStats();
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t max_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, max_count);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) const {
     return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
 }
 
+std::vector<Document> SearchServer::FindTopDocumentsWithDeadline(const QueryDeadline& deadline, std::string_view raw_query,
+    DocumentStatus status, size_t max_count) const {
+    const QueryContextLease context;
+    context->deadline = deadline;
+    ParseQuery(raw_query, true, *context);
+    return FindTopDocumentsByStatus(std::execution::seq, *context, status, max_count);
+}
+
 int SearchServer::GetDocumentCount() const {
-    return static_cast<int>(documents_.size());
+    return static_cast<int>(LoadVersion()->document_count);
 }
 
-const std::set<int>::const_iterator SearchServer::begin() const noexcept {
-    return document_ids_.begin();
+DocumentIdIterator SearchServer::begin() const {
+    const auto version = LoadVersion();
+    std::call_once(version->document_ids_flag, [&version] {
+        std::vector<int> document_ids;
+        document_ids.reserve(version->document_count);
+        for (const auto& segment : version->segments) {
+            for (DocumentOrdinal ordinal = segment->GetFirstOrdinal(); ordinal < segment->GetEndOrdinal(); ++ordinal) {
+                if (!version->removed->IsRemoved(ordinal) && segment->GetDocumentId(ordinal) >= 0) {
+                    document_ids.push_back(segment->GetDocumentId(ordinal));
+                }
+            }
+        }
+        std::sort(document_ids.begin(), document_ids.end());
+        version->document_ids = std::make_shared<const std::vector<int>>(std::move(document_ids));
+        });
+    return DocumentIdIterator(version->document_ids);
 }
 
-const std::set<int>::const_iterator SearchServer::end() const noexcept {
-    return document_ids_.end();
+DocumentIdIterator SearchServer::end() const noexcept {
+    return DocumentIdIterator();
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy& seq, std::string_view raw_query, int document_id) const {
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy&, std::string_view raw_query, int document_id) const {
     return MatchDocument(raw_query, document_id);
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
-    if ((document_id < 0) || (!documents_.count(document_id))) {
+    const auto version = LoadVersion();
+    const DocumentLocation location = FindDocument(*version, document_id);
+    if ((document_id < 0) || (location.segment == nullptr)) {
         throw std::invalid_argument("Invalid ID"s);
     }
 
-    const Query query = ParseQuery(raw_query,true);
+    const QueryContextLease context;
+    ParseQuery(raw_query, true, *context);
+    const Query& query = context->query;
+    const IndexSegment& segment = *location.segment;
+    const DocumentOrdinal ordinal = location.ordinal;
 
     std::vector<std::string_view> matched_words;
     for (const std::string_view word : query.minus_words) {
-        if (!word_to_document_freqs_.count(word)) {
+        const auto term_id = terms_.FindTerm(word);
+        if (!term_id) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.clear();
-            return { {}, documents_.at(document_id).status };
+        if (segment.FindPostings(*term_id).Contains(ordinal)) {
+            return { std::vector<std::string_view>{}, segment.GetStatus(ordinal) };
         }
     }
     for (const std::string_view word : query.plus_words) {
-        if (!word_to_document_freqs_.count(word)) {
+        const auto term_id = terms_.FindTerm(word);
+        if (!term_id) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+        if (segment.FindPostings(*term_id).Contains(ordinal)) {
+            matched_words.push_back(terms_.GetTerm(*term_id));
         }
     }
 
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, segment.GetStatus(ordinal) };
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy& par, std::string_view raw_query, int document_id) const {
-    if ((document_id < 0) || (!documents_.count(document_id))) {
+    const auto version = LoadVersion();
+    const DocumentLocation location = FindDocument(*version, document_id);
+    if ((document_id < 0) || (location.segment == nullptr)) {
         throw std::invalid_argument("Invalid ID"s);
     }
 
-    const Query& query = ParseQuery(raw_query);
-    const auto& words = document_to_word_freqs_.at(document_id);
-
-    if (std::any_of(query.minus_words.begin(), query.minus_words.end(), [&words]
-    (const std::string_view word) {return words.count(word); })) {
-        return { {}, documents_.at(document_id).status
-        };
+    const QueryContextLease context;
+    ParseQuery(raw_query, false, *context);
+    const Query& query = context->query;
+    const DocumentStatus status = location.segment->GetStatus(location.ordinal);
+    const WordFreqs word_freqs = location.segment->GetWordFreqs(location.ordinal);
+    const auto contains_word = [this, word_freqs](const std::string_view word) {
+        const auto term_id = terms_.FindTerm(word);
+        return term_id && ContainsTerm(word_freqs, *term_id);
+    };
+
+    if (std::any_of(query.minus_words.begin(), query.minus_words.end(), contains_word)) {
+        return { std::vector<std::string_view>{}, status };
     }
 
     std::vector<std::string_view> matched_words;
     matched_words.reserve(query.plus_words.size());
-    std::copy_if(query.plus_words.begin(), query.plus_words.end(), std::back_inserter(matched_words),
-        [&words](const std::string_view word) {
-            return words.count(word);
-        });
+    for (const std::string_view word : query.plus_words) {
+        if (contains_word(word)) {
+            matched_words.push_back(terms_.GetTerm(*terms_.FindTerm(word)));
+        }
+    }
 
     std::sort(par, matched_words.begin(), matched_words.end());
     auto iter = std::unique(matched_words.begin(), matched_words.end());
     matched_words.erase(iter, matched_words.end());
 
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, status };
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static const std::map<std::string_view, double> result;
-    if (!document_to_word_freqs_.count(document_id)) {
-        return result;
-    }
-    else {
-        return document_to_word_freqs_.at(document_id);
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    std::map<std::string_view, double> result;
+    const auto version = LoadVersion();
+    const DocumentLocation location = FindDocument(*version, document_id);
+    if (location.segment != nullptr) {
+        for (const auto& [term_id, term_freq] : location.segment->GetWordFreqs(location.ordinal)) {
+            result.emplace(terms_.GetTerm(term_id), term_freq);
+        }
     }
+    return result;
 }
 
+// Документ остаётся в своём сегменте до ближайшего слияния, а до тех пор
+// скрывается отметкой; его слова учитываются в term_counts, чтобы число
+// документов со словом оставалось точным.
 void SearchServer::RemoveDocument(int document_id) {
+    std::lock_guard lock(write_mutex_);
+    if (!HasDocument(document_id)) {
+        return;
+    }
+    MarkRemoved(document_id, *LoadVersion());
+    MergeSegments();
+    PublishVersion();
+}
 
-    if (document_to_word_freqs_.count(document_id)) {
-        std::map<std::string_view, double> search_element = document_to_word_freqs_[document_id];
-
-        for (auto [key, value] : search_element) {
-            word_to_document_freqs_[key].erase(document_id);
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    std::lock_guard lock(write_mutex_);
+    const std::shared_ptr<const IndexVersion> version = LoadVersion();
+    bool removed_any = false;
+    for (const int document_id : document_ids) {
+        if (HasDocument(document_id)) {
+            MarkRemoved(document_id, *version);
+            removed_any = true;
         }
+    }
+    if (removed_any) {
+        MergeSegments();
+        PublishVersion();
+    }
+}
 
-        document_to_word_freqs_.erase(document_id);
-        documents_.erase(document_id);
-        document_ids_.erase(document_id);
+// Удаление только помечает документ: вхождения остаются в сегменте, пока
+// тот не сольётся с соседями или не наберёт достаточно удалённых документов
+void SearchServer::MarkRemoved(int document_id, const IndexVersion& version) {
+    const DocumentLocation location = FindDocument(version, document_id);
+    const DocumentOrdinal ordinal = location.ordinal;
+    RemovedDocuments& removed = GetMutableRemovedDocuments();
+    removed.SetRemoved(ordinal, true);
+    for (const auto& [term_id, term_freq] : location.segment->GetWordFreqs(ordinal)) {
+        removed.term_counts.Set(term_id, removed.term_counts.Get(term_id) + 1);
     }
+
+    if (head_ && ordinal >= head_->GetFirstOrdinal()) {
+        ++head_removed_count_;
+    }
+    else {
+        const auto segment = std::upper_bound(segments_.begin(), segments_.end(), ordinal,
+            [](DocumentOrdinal ordinal, const SealedSegment& segment) {
+                return ordinal < segment.index->GetEndOrdinal();
+            });
+        ++segment->removed_count;
+        GetMutableDocumentOrdinals().Erase(document_id);
+    }
+    --document_count_;
 }
 
 bool SearchServer::IsStopWord(std::string_view word) const {
@@ -148,21 +364,403 @@ bool SearchServer::IsValidWord(std::string_view word) {
         });
 }
 
-double SearchServer::ComputeWordFreq(std::string_view word) const {
-    return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordFreq(size_t document_count, size_t document_freq) {
+    return std::log(document_count * 1.0 / document_freq);
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
-    std::vector<std::string_view> words;
-    for (const auto& word : SplitIntoWordsView(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Проблема запроса!"s);
+// Списки всех сегментов складываются в общие массивы контекста, место в
+// которых резервируется заранее, чтобы ссылки на них не сдвигались
+void SearchServer::FindQueryPostings(const IndexVersion& version, QueryContext& context) const {
+    auto& plus_terms = context.plus_terms;
+    plus_terms.clear();
+    for (auto word : context.query.plus_words) {
+        const auto term_id = terms_.FindTerm(word);
+        if (!term_id) {
+            continue;
         }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+        if (const auto inverse_document_freq = FindInverseDocumentFreq(version, *term_id)) {
+            plus_terms.emplace_back(*term_id, *inverse_document_freq);
         }
     }
-    return words;
+    auto& minus_terms = context.minus_terms;
+    minus_terms.clear();
+    for (auto word : context.query.minus_words) {
+        const auto term_id = terms_.FindTerm(word);
+        if (term_id && FindInverseDocumentFreq(version, *term_id)) {
+            minus_terms.push_back(*term_id);
+        }
+    }
+
+    auto& plus_postings = context.plus_postings;
+    auto& minus_postings = context.minus_postings;
+    plus_postings.clear();
+    minus_postings.clear();
+    plus_postings.reserve(version.segments.size() * plus_terms.size());
+    minus_postings.reserve(version.segments.size() * minus_terms.size());
+    context.segment_postings.clear();
+    for (const auto& index : version.segments) {
+        const size_t plus_begin = plus_postings.size();
+        for (const auto& [term_id, inverse_document_freq] : plus_terms) {
+            const PostingListView postings = index->FindPostings(term_id);
+            if (!postings.empty()) {
+                plus_postings.emplace_back(postings, inverse_document_freq);
+            }
+        }
+        if (plus_postings.size() == plus_begin) {
+            continue;
+        }
+        const size_t minus_begin = minus_postings.size();
+        for (const TermId term_id : minus_terms) {
+            const PostingListView postings = index->FindPostings(term_id);
+            if (!postings.empty()) {
+                minus_postings.push_back(postings);
+            }
+        }
+        context.segment_postings.push_back({ index.get(), {
+            { plus_postings.data() + plus_begin, plus_postings.size() - plus_begin },
+            { minus_postings.data() + minus_begin, minus_postings.size() - minus_begin } } });
+    }
+}
+
+// IDF слова, которого нет ни в одном документе версии, не определён. Число
+// документов со словом — вхождения во всех сегментах за вычетом удалённых,
+// но ещё не выброшенных слиянием документов. Оно и IDF меняются с каждой
+// версией, поэтому IDF кешируется в словаре с отметкой версии; отсутствие
+// документов кешируется как отрицательное значение.
+std::optional<double> SearchServer::FindInverseDocumentFreq(const IndexVersion& version, TermId term_id) const {
+    std::optional<double> inverse_document_freq = terms_.FindCachedValue(term_id, version.generation);
+    if (!inverse_document_freq) {
+        size_t document_freq = 0;
+        for (const auto& segment : version.segments) {
+            document_freq += segment->FindPostings(term_id).size();
+        }
+        document_freq -= version.removed->term_counts.Get(term_id);
+        inverse_document_freq = document_freq > 0 ? ComputeWordFreq(version.document_count, document_freq) : -1.0;
+        terms_.CacheValue(term_id, version.generation, *inverse_document_freq);
+    }
+    if (*inverse_document_freq < 0.0) {
+        return std::nullopt;
+    }
+    return inverse_document_freq;
+}
+
+bool SearchServer::IsPruningWorthwhile(const std::vector<SegmentPostings>& segment_postings, size_t max_count) const {
+    size_t posting_count = 0;
+    for (const SegmentPostings& segment : segment_postings) {
+        for (const auto& [postings, inverse_document_freq] : segment.postings.plus_postings) {
+            posting_count += postings.size();
+        }
+    }
+    return max_count > 0 && posting_count >= DYNAMIC_PRUNING_MIN_POSTINGS;
+}
+
+std::shared_ptr<const SearchServer::IndexVersion> SearchServer::LoadVersion() const {
+    return std::atomic_load(&version_);
+}
+
+void SearchServer::PublishVersion() {
+    auto version = std::make_shared<IndexVersion>();
+    version->segments.reserve(segments_.size() + 1);
+    for (const SealedSegment& segment : segments_) {
+        version->segments.push_back(segment.index);
+    }
+    if (head_ && head_->GetDocumentCount() > 0) {
+        version->segments.push_back(std::make_shared<const IndexSegment>(head_));
+    }
+    version->removed = removed_;
+    version->document_ordinals = document_ordinals_;
+    version->document_count = document_count_;
+    version->next_ordinal = next_ordinal_;
+    const auto previous = LoadVersion();
+    version->generation = previous ? previous->generation + 1 : 0;
+    std::atomic_store(&version_, std::shared_ptr<const IndexVersion>(std::move(version)));
+}
+
+// Отметки, которые видит опубликованная версия, копируются перед изменением
+SearchServer::RemovedDocuments& SearchServer::GetMutableRemovedDocuments() {
+    if (removed_.use_count() > 1) {
+        removed_ = std::make_shared<RemovedDocuments>(*removed_);
+    }
+    else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *removed_;
+}
+
+SearchServer::DocumentOrdinals& SearchServer::GetMutableDocumentOrdinals() {
+    if (document_ordinals_.use_count() > 1) {
+        document_ordinals_ = std::make_shared<DocumentOrdinals>(*document_ordinals_);
+    }
+    else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *document_ordinals_;
+}
+
+void SearchServer::AddSegment(IndexSegment segment) {
+    const size_t level = ComputeSegmentLevel(segment);
+    segments_.push_back({ std::make_shared<const IndexSegment>(std::move(segment)), level });
+    MergeSegments();
+    PublishVersion();
+}
+
+// Голова сливается в обычный сегмент без перенумерации, а удалённые в ней
+// документы выбросит одно из следующих слияний. Неудалённые документы
+// головы переходят в DocumentOrdinals.
+void SearchServer::SealHeadSegment() {
+    if (!head_) {
+        return;
+    }
+    if (head_->GetDocumentCount() > 0) {
+        const ArrayView<int> document_ids = head_->GetDocumentIds();
+        DocumentOrdinals& document_ordinals = GetMutableDocumentOrdinals();
+        for (size_t index = 0; index < document_ids.size(); ++index) {
+            const DocumentOrdinal ordinal = head_->GetFirstOrdinal() + static_cast<DocumentOrdinal>(index);
+            if (!removed_->IsRemoved(ordinal)) {
+                document_ordinals.Set(document_ids[index], ordinal);
+            }
+        }
+        const auto snapshot = std::make_shared<const IndexSegment>(head_);
+        auto segment = std::make_shared<const IndexSegment>(
+            MergeIndexSegments({ snapshot }, std::vector<bool>(head_->GetDocumentCount())));
+        const size_t level = ComputeSegmentLevel(*segment);
+        segments_.push_back({ std::move(segment), level, head_removed_count_ });
+    }
+    head_.reset();
+    head_removed_count_ = 0;
+    MergeSegments();
+}
+
+// Сливаются SEGMENT_MERGE_FACTOR соседних сегментов одного уровня. Небольшие
+// группы сливаются сразу, крупные — в фоне, по одной за раз; результат
+// фонового слияния подменяет свои входы при следующем изменении индекса.
+void SearchServer::MergeSegments() {
+    if (merge_.result.valid() && merge_.result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        const auto first = std::find_if(segments_.begin(), segments_.end(), [this](const SealedSegment& segment) {
+            return segment.index.get() == merge_.first_input;
+            });
+        ReplaceSegments(first - segments_.begin(), merge_.segment_count, merge_.result.get(), *merge_.removed_ordinals);
+        merge_ = SegmentMerge();
+    }
+
+    const auto is_merging = [this](const SealedSegment& segment) {
+        return segment.index.get() == merge_.first_input;
+    };
+
+    size_t first = 0;
+    while (first + SEGMENT_MERGE_FACTOR <= segments_.size()) {
+        const size_t end = first + SEGMENT_MERGE_FACTOR;
+        const auto mismatch = std::find_if(segments_.begin() + first + 1, segments_.begin() + end,
+            [this, first](const SealedSegment& segment) {
+                return segment.level != segments_[first].level;
+            });
+        if (mismatch != segments_.begin() + end) {
+            first = mismatch - segments_.begin();
+            continue;
+        }
+        const auto merging = std::find_if(segments_.begin() + first, segments_.begin() + end, is_merging);
+        if (merging != segments_.begin() + end) {
+            first = (merging - segments_.begin()) + merge_.segment_count;
+            continue;
+        }
+
+        switch (MergeSegmentRun(first, SEGMENT_MERGE_FACTOR)) {
+        case MergeStart::INLINE:
+            first = 0;
+            break;
+        case MergeStart::BACKGROUND:
+            first = end;
+            break;
+        case MergeStart::DEFERRED:
+            ++first;
+            break;
+        }
+    }
+
+    // Сегмент, в котором накопилось много удалённых документов, сливается
+    // сам с собой, чтобы выбросить их вхождения, не дожидаясь соседей
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (is_merging(segments_[i])) {
+            i += merge_.segment_count - 1;
+            continue;
+        }
+        const IndexSegment& segment = *segments_[i].index;
+        const size_t ordinal_count = segment.GetEndOrdinal() - segment.GetFirstOrdinal();
+        if (segments_[i].removed_count > 0 && segments_[i].removed_count >= SEGMENT_COMPACTION_REMOVED_SHARE * ordinal_count) {
+            MergeSegmentRun(i, 1);
+        }
+    }
+}
+
+// Небольшие группы сливаются сразу, крупные — в фоне, если фоновое слияние
+// ещё не идёт
+SearchServer::MergeStart SearchServer::MergeSegmentRun(size_t first_segment, size_t segment_count) {
+    std::vector<std::shared_ptr<const IndexSegment>> inputs;
+    size_t posting_count = 0;
+    for (size_t i = first_segment; i < first_segment + segment_count; ++i) {
+        inputs.push_back(segments_[i].index);
+        posting_count += segments_[i].index->GetPostingCount();
+    }
+    if (posting_count >= BACKGROUND_MERGE_MIN_POSTINGS && merge_.result.valid()) {
+        return MergeStart::DEFERRED;
+    }
+
+    auto removed_ordinals = std::make_shared<const std::vector<bool>>(
+        CollectRemovedOrdinals(*removed_, inputs.front()->GetFirstOrdinal(), inputs.back()->GetEndOrdinal()));
+    if (posting_count < BACKGROUND_MERGE_MIN_POSTINGS) {
+        ReplaceSegments(first_segment, segment_count,
+            std::make_shared<const IndexSegment>(MergeIndexSegments(inputs, *removed_ordinals)), *removed_ordinals);
+        return MergeStart::INLINE;
+    }
+
+    merge_.first_input = inputs.front().get();
+    merge_.segment_count = segment_count;
+    merge_.removed_ordinals = removed_ordinals;
+    merge_.result = std::async(std::launch::async,
+        [inputs = std::move(inputs), removed_ordinals]() -> std::shared_ptr<const IndexSegment> {
+            return std::make_shared<const IndexSegment>(MergeIndexSegments(inputs, *removed_ordinals));
+        });
+    return MergeStart::BACKGROUND;
+}
+
+// Слитый сегмент перенумерован, поэтому отметки удаления в диапазоне входов
+// снимаются, а новые номера неудалённых документов записываются в
+// DocumentOrdinals. Выброшенные документы больше не учитываются в
+// term_counts, а удалённые, пока шло фоновое слияние, остались в слитом
+// сегменте и отмечаются под новыми номерами.
+void SearchServer::ReplaceSegments(size_t first_segment, size_t segment_count, std::shared_ptr<const IndexSegment> merged,
+    const std::vector<bool>& removed_ordinals) {
+    std::vector<std::shared_ptr<const IndexSegment>> inputs;
+    for (size_t i = first_segment; i < first_segment + segment_count; ++i) {
+        inputs.push_back(segments_[i].index);
+    }
+    const DocumentOrdinal first_ordinal = inputs.front()->GetFirstOrdinal();
+    const std::vector<DocumentOrdinal> merged_ordinals = ComputeMergedOrdinals(inputs, removed_ordinals);
+
+    size_t removed_count = 0;
+    size_t input = 0;
+    for (size_t i = 0; i < removed_ordinals.size(); ++i) {
+        const DocumentOrdinal ordinal = first_ordinal + static_cast<DocumentOrdinal>(i);
+        while (inputs[input]->GetEndOrdinal() <= ordinal) {
+            ++input;
+        }
+        if (!removed_->IsRemoved(ordinal)) {
+            if (merged_ordinals[i] != ordinal && inputs[input]->GetFirstOrdinal() <= ordinal
+                && inputs[input]->GetDocumentId(ordinal) >= 0) {
+                GetMutableDocumentOrdinals().Set(inputs[input]->GetDocumentId(ordinal), merged_ordinals[i]);
+            }
+            continue;
+        }
+        RemovedDocuments& removed = GetMutableRemovedDocuments();
+        removed.SetRemoved(ordinal, false);
+        if (!removed_ordinals[i]) {
+            removed.SetRemoved(merged_ordinals[i], true);
+            ++removed_count;
+            continue;
+        }
+        for (const auto& [term_id, term_freq] : inputs[input]->GetWordFreqs(ordinal)) {
+            removed.term_counts.Set(term_id, removed.term_counts.Get(term_id) - 1);
+        }
+    }
+
+    const auto first = segments_.begin() + first_segment;
+    segments_.erase(first + 1, first + segment_count);
+    *first = { std::move(merged), 0, removed_count };
+    first->level = ComputeSegmentLevel(*first->index);
+}
+
+std::vector<bool> SearchServer::CollectRemovedOrdinals(const RemovedDocuments& removed,
+    DocumentOrdinal first_ordinal, DocumentOrdinal end_ordinal) {
+    std::vector<bool> removed_ordinals(end_ordinal - first_ordinal);
+    for (DocumentOrdinal ordinal = first_ordinal; ordinal < end_ordinal; ++ordinal) {
+        removed_ordinals[ordinal - first_ordinal] = removed.IsRemoved(ordinal);
+    }
+    return removed_ordinals;
+}
+
+// Уровень сегмента растёт на единицу при каждом увеличении диапазона его
+// номеров в SEGMENT_MERGE_FACTOR раз
+size_t SearchServer::ComputeSegmentLevel(const IndexSegment& segment) {
+    size_t level = 0;
+    for (size_t size = segment.GetEndOrdinal() - segment.GetFirstOrdinal(); size >= SEGMENT_MERGE_FACTOR; size /= SEGMENT_MERGE_FACTOR) {
+        ++level;
+    }
+    return level;
+}
+
+// Голова новее запечатанных сегментов, поэтому документ, найденный в ней,
+// последний с этим id, даже если он удалён. Сегмент запечатанного документа
+// находится по номеру.
+SearchServer::DocumentLocation SearchServer::FindDocument(const IndexVersion& version, int document_id) {
+    if (!version.segments.empty() && version.segments.back()->IsHeadSnapshot()) {
+        const auto ordinal = version.segments.back()->FindDocument(document_id);
+        if (ordinal) {
+            if (version.removed->IsRemoved(*ordinal)) {
+                return {};
+            }
+            return { version.segments.back().get(), *ordinal };
+        }
+    }
+    const auto ordinal = version.document_ordinals->Find(document_id);
+    if (!ordinal) {
+        return {};
+    }
+    const auto segment = std::upper_bound(version.segments.begin(), version.segments.end(), *ordinal,
+        [](DocumentOrdinal ordinal, const std::shared_ptr<const IndexSegment>& segment) {
+            return ordinal < segment->GetEndOrdinal();
+        });
+    return { segment->get(), *ordinal };
+}
+
+bool SearchServer::ContainsTerm(WordFreqs word_freqs, TermId term_id) {
+    const auto it = std::lower_bound(word_freqs.begin(), word_freqs.end(), term_id,
+        [](const WordFreq& item, TermId value) {
+            return item.first < value;
+        });
+    return it != word_freqs.end() && it->first == term_id;
+}
+
+void SearchServer::CheckNewDocumentId(int document_id) const {
+    if (document_id < 0) {
+        throw std::invalid_argument("Попытка добавить документ с отрицательным id!");
+    }
+
+    if (HasDocument(document_id)) {
+        throw std::invalid_argument("Попытка добавить документ c id ранее добавленного документа!");
+    }
+}
+
+bool SearchServer::HasDocument(int document_id) const {
+    if (head_) {
+        const auto ordinal = head_->FindDocument(document_id,
+            head_->GetFirstOrdinal() + static_cast<DocumentOrdinal>(head_->GetDocumentCount()));
+        if (ordinal && !removed_->IsRemoved(*ordinal)) {
+            return true;
+        }
+    }
+    return document_ordinals_->Find(document_id).has_value();
+}
+
+// Слова документа без стоп-слов с числом вхождений, по алфавиту
+SearchServer::TokenizedDocument SearchServer::TokenizeDocument(std::string_view document) const {
+    std::vector<std::string_view> words;
+    if (!SplitIntoValidWordsView(document, words)) {
+        throw std::invalid_argument("Наличие недопустимых символов!");
+    }
+    words.erase(std::remove_if(words.begin(), words.end(), [this](std::string_view word) {
+        return IsStopWord(word);
+        }), words.end());
+    std::sort(words.begin(), words.end());
+
+    TokenizedDocument result;
+    result.length = static_cast<uint32_t>(words.size());
+    for (const auto word : words) {
+        if (result.word_counts.empty() || result.word_counts.back().first != word) {
+            result.word_counts.emplace_back(word, 0);
+        }
+        ++result.word_counts.back().second;
+    }
+    return result;
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -179,12 +777,9 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view word) cons
         throw std::invalid_argument("Проблема в отсутствие слов после символа <минус> в поисковом запросе!");
     }
 
-    if ((word[0] == '-' && word[1] == '-') || word == "-") {
+    if (word == "-" || (word[0] == '-' && word[1] == '-')) {
         throw std::invalid_argument("Проблема поискового запроса с отрицательными словами!");
     }
-    if (!IsValidWord(word)) {
-        throw std::invalid_argument("Проблема с наличие недопустимых символов!");
-    }
     bool is_minus = false;
     if (word[0] == '-') {
         is_minus = true;
@@ -195,11 +790,24 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view word) cons
 }
 
 
-SearchServer::Query SearchServer::ParseQuery(std::string_view text,bool sort) const {
-    Query result;
+void SearchServer::ParseQuery(std::string_view text, bool sort, QueryContext& context) const {
+    Query& result = context.query;
+    result.plus_words.clear();
+    result.minus_words.clear();
 
-    for (auto word : SplitIntoWordsView(text)) {
+    // Недопустимые символы проверяются при разбиении; если они есть, запрос
+    // разбирается заново по словам, чтобы ошибки шли в прежнем порядке
+    std::vector<std::string_view>& words = context.words;
+    words.clear();
+    const bool is_valid = SplitIntoValidWordsView(text, words);
+    if (!is_valid) {
+        words = SplitIntoWordsView(text);
+    }
+    for (auto word : words) {
         QueryWord query_word = ParseQueryWord(word);
+        if (!is_valid && !IsValidWord(word)) {
+            throw std::invalid_argument("Проблема с наличие недопустимых символов!");
+        }
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
                 result.minus_words.push_back(query_word.data);
@@ -220,6 +828,42 @@ SearchServer::Query SearchServer::ParseQuery(std::string_view text,bool sort) co
         result.minus_words.resize(std::distance(result.minus_words.begin(), not_unique_minus_word));
 
     }
+}
 
-    return result;
+SearchServer::QueryContextLease::QueryContextLease() {
+    auto& pool = GetPool();
+    if (pool.empty()) {
+        context_ = std::make_unique<QueryContext>();
+    }
+    else {
+        context_ = std::move(pool.back());
+        pool.pop_back();
+        context_->deadline = QueryDeadline();
+    }
+}
+
+SearchServer::QueryContextLease::~QueryContextLease() {
+    GetPool().push_back(std::move(context_));
+}
+
+std::vector<std::unique_ptr<SearchServer::QueryContext>>& SearchServer::QueryContextLease::GetPool() {
+    static thread_local std::vector<std::unique_ptr<QueryContext>> pool;
+    return pool;
+}
+
+// Слова запроса уже отсортированы и без повторов, плюс-слова не начинаются
+// с минуса, а пробелов в словах нет, поэтому ключ однозначен
+std::string SearchServer::MakeQueryCacheKey(const Query& query, DocumentStatus status, bool is_sequenced, size_t max_count) {
+    std::string key = std::to_string(static_cast<int>(status));
+    key += is_sequenced ? " s " : " p ";
+    key += std::to_string(max_count);
+    for (const std::string_view word : query.plus_words) {
+        key += ' ';
+        key += word;
+    }
+    for (const std::string_view word : query.minus_words) {
+        key += " -";
+        key += word;
+    }
+    return key;
 }
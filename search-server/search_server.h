@@ -3,7 +3,17 @@
 #include "document.h"
 #include "string_processing.h"
 #include "log_duration.h"
-#include "concurrent_map.h"
+#include "term_dictionary.h"
+#include "posting_list.h"
+#include "index_segment.h"
+#include "head_segment.h"
+#include "chunked_array.h"
+#include "chunked_hash_map.h"
+#include "index_file.h"
+#include "top_documents.h"
+#include "score_accumulator.h"
+#include "query_cache.h"
+#include "query_deadline.h"
 
 #include <iostream>
 #include <string>
@@ -16,11 +26,94 @@
 #include <algorithm>
 #include <stdexcept>
 #include <cmath>
+#include <limits>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <exception>
+#include <future>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <fstream>
+#include <iterator>
+#include <cstddef>
 
 using namespace std::string_literals;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-inline static constexpr double EPSILON = 1e-6;
+const size_t DYNAMIC_PRUNING_MIN_POSTINGS = 4096;
+const size_t PARTITIONS_PER_THREAD = 4;
+const size_t SEGMENT_MERGE_FACTOR = 16;
+const size_t BACKGROUND_MERGE_MIN_POSTINGS = 1 << 16;
+const size_t HEAD_SEGMENT_MAX_DOCUMENTS = 4096;
+const size_t HEAD_SEGMENT_MAX_POSTINGS = 1 << 17;
+const size_t HEAD_SEGMENT_MAX_TEXT_SIZE = 1 << 22;
+const double SEGMENT_COMPACTION_REMOVED_SHARE = 0.25;
+
+// Запросы (FindTopDocuments, MatchDocument, GetWordFrequencies,
+// GetDocumentCount) можно выполнять из любых потоков одновременно с
+// изменениями индекса: каждый запрос работает с неизменяемой версией индекса,
+// взятой в его начале, и не ждёт писателей. Изменения выполняются по одному.
+// Обход идентификаторов через begin()/end() тоже идёт по версии, взятой в
+// begin().
+class SearchServer;
+
+// Итератор по возрастающим id документов одной версии индекса. Держит
+// список id, поэтому остаётся действительным после изменений индекса.
+// Итератор по умолчанию, как и любой дошедший до конца, равен end().
+class DocumentIdIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const int*;
+    using reference = const int&;
+
+    DocumentIdIterator() = default;
+
+    reference operator*() const {
+        return (*document_ids_)[position_];
+    }
+
+    pointer operator->() const {
+        return &**this;
+    }
+
+    DocumentIdIterator& operator++() {
+        ++position_;
+        return *this;
+    }
+
+    DocumentIdIterator operator++(int) {
+        DocumentIdIterator previous = *this;
+        ++position_;
+        return previous;
+    }
+
+    bool operator==(const DocumentIdIterator& other) const {
+        return IsEnd() ? other.IsEnd() : document_ids_ == other.document_ids_ && position_ == other.position_;
+    }
+
+    bool operator!=(const DocumentIdIterator& other) const {
+        return !(*this == other);
+    }
+
+private:
+    friend class SearchServer;
+
+    std::shared_ptr<const std::vector<int>> document_ids_;
+    size_t position_ = 0;
+
+    explicit DocumentIdIterator(std::shared_ptr<const std::vector<int>> document_ids)
+        : document_ids_(std::move(document_ids))
+    {
+    }
+
+    bool IsEnd() const {
+        return !document_ids_ || position_ == document_ids_->size();
+    }
+};
 
 class SearchServer {
 public:
@@ -37,29 +130,61 @@ public:
     {
     }
 
+    // Открывает индекс, сохранённый Save. Списки вхождений, рейтинги, статусы
+    // и тексты документов читаются прямо из отображённого в память файла,
+    // поэтому файл нельзя менять, пока сервер и его версии индекса живы.
+    static SearchServer Open(const std::string& path);
+
+    // Сохраняет текущую версию индекса без удалённых документов
+    void Save(const std::string& path) const;
+
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
+    template <typename ExecutionPolicy>
+    void AddDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents);
+
     template <typename DocumentPredicate, typename Execution>
-    std::vector<Document> FindTopDocuments(Execution&& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(Execution&& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
 
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
 
     template <typename Execution>
-    std::vector<Document> FindTopDocuments(Execution&& policy, std::string_view raw_query, DocumentStatus status) const;
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(Execution&& policy, std::string_view raw_query, DocumentStatus status,
+        size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
 
     template <typename Execution>
     std::vector<Document> FindTopDocuments(Execution&& policy, std::string_view raw_query) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
+    // Как FindTopDocuments без политики, но если запрос не уложился в срок,
+    // обход списков вхождений прерывается и бросается QueryDeadlineExceeded
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsWithDeadline(const QueryDeadline& deadline, std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocumentsWithDeadline(const QueryDeadline& deadline, std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Включает кеш результатов FindTopDocuments с фильтром по статусу на
+    // capacity запросов; 0 выключает кеш. Записи устаревают при любом
+    // изменении индекса.
+    void SetQueryCacheCapacity(size_t capacity);
+
+    QueryCacheStats GetQueryCacheStats() const;
+
     int GetDocumentCount() const;
 
-    const std::set<int>::const_iterator begin() const noexcept;
-    const std::set<int>::const_iterator end() const noexcept;
+    DocumentIdIterator begin() const;
+    DocumentIdIterator end() const noexcept;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
 
@@ -67,32 +192,158 @@ public:
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy& policy, std::string_view raw_query, int document_id) const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
 
     void RemoveDocument(int document_id);
 
+    // Удаляет документы с публикацией одной новой версии индекса на всех;
+    // отсутствующие id пропускаются
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
     template <typename ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy&& policy, int document_id);
 
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
-        std::string string;
+    // Индекс разбит на сегменты по диапазонам внутренних номеров документов.
+    // Документы, добавленные по одному, дописываются в головной сегмент,
+    // который по заполнении запечатывается в неизменяемый; пакет документов
+    // сразу становится отдельным сегментом. Когда набирается
+    // SEGMENT_MERGE_FACTOR соседних запечатанных сегментов одного уровня
+    // (уровень растёт как логарифм числа документов), они сливаются:
+    // небольшие сразу, крупные в фоне. Удалённые документы отмечаются в
+    // RemovedDocuments и физически выбрасываются при слиянии, которое
+    // перенумеровывает оставшиеся подряд; номера не переиспользуются, так что
+    // между сегментами остаются пустые промежутки, и от удалённого документа
+    // остаётся только бит отметок.
+    //
+    // Документ находится по id так: в голове — по её таблице id, в
+    // запечатанных сегментах — по DocumentOrdinals, где лежат номера всех
+    // неудалённых документов этих сегментов. Она меняется при добавлении
+    // пакета, запечатывании головы, удалении и перенумерующем слиянии.
+    //
+    // Всё, что нужно запросам, собрано в версии индекса. Писатель готовит
+    // новую версию, разделяя с прежней сегменты, голову (версия видит её
+    // снимок) и неизменённые куски отметок об удалении и номеров документов,
+    // и публикует её атомарной заменой указателя. Читатель держит взятую
+    // версию, пока она ему нужна.
+    struct RemovedDocuments {
+        ChunkedArray<uint64_t, 64> ordinals;
+        // Сколько удалённых документов с этим словом ещё лежат в сегментах
+        ChunkedArray<uint32_t> term_counts;
+
+        bool IsRemoved(DocumentOrdinal ordinal) const;
+
+        void SetRemoved(DocumentOrdinal ordinal, bool is_removed);
+    };
+
+    using DocumentOrdinals = ChunkedHashMap<int, DocumentOrdinal>;
+
+    struct IndexVersion {
+        std::vector<std::shared_ptr<const IndexSegment>> segments;
+        std::shared_ptr<const RemovedDocuments> removed;
+        std::shared_ptr<const DocumentOrdinals> document_ordinals;
+        size_t document_count = 0;
+        // Номер, который получит следующий добавленный документ
+        DocumentOrdinal next_ordinal = 0;
+        // Растёт с каждой опубликованной версией
+        uint64_t generation = 0;
+        // Отсортированные id документов версии; собираются при первом обходе
+        mutable std::once_flag document_ids_flag;
+        mutable std::shared_ptr<const std::vector<int>> document_ids;
+    };
+
+    struct SealedSegment {
+        std::shared_ptr<const IndexSegment> index;
+        size_t level = 0;
+        // Удалённые документы, вхождения которых ещё лежат в сегменте
+        size_t removed_count = 0;
+    };
+
+    enum class MergeStart {
+        INLINE,
+        BACKGROUND,
+        DEFERRED,
+    };
+
+    struct SegmentMerge {
+        std::future<std::shared_ptr<const IndexSegment>> result;
+        const IndexSegment* first_input = nullptr;
+        size_t segment_count = 0;
+        std::shared_ptr<const std::vector<bool>> removed_ordinals;
+    };
+
+    struct DocumentLocation {
+        const IndexSegment* segment = nullptr;
+        DocumentOrdinal ordinal = 0;
     };
 
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
+    TermDictionary terms_;
+    std::shared_ptr<const IndexVersion> version_;
+
+    std::mutex write_mutex_;
+    std::vector<SealedSegment> segments_;
+    // Пуст, пока после пакета или запечатывания не добавлен новый документ
+    std::shared_ptr<HeadSegment> head_;
+    size_t head_removed_count_ = 0;
+    std::shared_ptr<RemovedDocuments> removed_;
+    std::shared_ptr<DocumentOrdinals> document_ordinals_;
+    size_t document_count_ = 0;
+    SegmentMerge merge_;
+    DocumentOrdinal next_ordinal_ = 0;
 
     const std::set<std::string, std::less<>> stop_words_;
-    std::set<int> document_ids_;
+    mutable QueryCache query_cache_;
 
     bool IsStopWord(std::string_view word) const;
 
     static bool IsValidWord(std::string_view word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    struct TokenizedDocument {
+        std::vector<std::pair<std::string_view, uint32_t>> word_counts;
+        uint32_t length = 0;
+    };
+
+    explicit SearchServer(IndexFileReader reader);
+
+    static std::set<std::string, std::less<>> ReadStrings(IndexFileReader& reader);
+
+    template <typename StringContainer>
+    static void WriteStrings(IndexFileWriter& writer, const StringContainer& strings);
+
+    void CheckNewDocumentId(int document_id) const;
+
+    // Есть ли неудалённый документ с этим id; вызывается только писателем
+    bool HasDocument(int document_id) const;
+
+    TokenizedDocument TokenizeDocument(std::string_view document) const;
+
+    std::shared_ptr<const IndexVersion> LoadVersion() const;
+
+    void PublishVersion();
+
+    RemovedDocuments& GetMutableRemovedDocuments();
+
+    DocumentOrdinals& GetMutableDocumentOrdinals();
+
+    void AddSegment(IndexSegment segment);
+
+    void SealHeadSegment();
+
+    void MarkRemoved(int document_id, const IndexVersion& version);
+
+    void MergeSegments();
+
+    MergeStart MergeSegmentRun(size_t first_segment, size_t segment_count);
+
+    void ReplaceSegments(size_t first_segment, size_t segment_count, std::shared_ptr<const IndexSegment> merged,
+        const std::vector<bool>& removed_ordinals);
+
+    static std::vector<bool> CollectRemovedOrdinals(const RemovedDocuments& removed,
+        DocumentOrdinal first_ordinal, DocumentOrdinal end_ordinal);
+
+    static size_t ComputeSegmentLevel(const IndexSegment& segment);
+
+    static DocumentLocation FindDocument(const IndexVersion& version, int document_id);
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
@@ -109,62 +360,232 @@ private:
         std::vector<std::string_view> minus_words;
     };
 
-    Query ParseQuery(std::string_view text,bool sort = false) const;
+    // Списки лежат в общих массивах QueryContext
+    struct QueryPostings {
+        ArrayView<std::pair<PostingListView, double>> plus_postings;
+        ArrayView<PostingListView> minus_postings;
+    };
+
+    // Списки вхождений слов запроса в одном сегменте
+    struct SegmentPostings {
+        const IndexSegment* segment = nullptr;
+        QueryPostings postings;
+    };
+
+    struct ScoredTerm {
+        PostingCursor cursor;
+        double inverse_document_freq;
+        double upper_bound;
+    };
+
+    // Рабочие массивы одного запроса, включая аккумулятор релевантности.
+    // Контексты переиспользуются потоком от запроса к запросу вместе с
+    // выделенной памятью, поэтому в установившемся режиме разбор запроса и
+    // подбор списков вхождений память не выделяют. Другого изменяемого
+    // состояния у запроса нет, поэтому вложенный запрос (например, из
+    // фильтра документов) не мешает внешнему.
+    struct QueryContext {
+        std::vector<std::string_view> words;
+        Query query;
+        std::vector<std::pair<TermId, double>> plus_terms;
+        std::vector<TermId> minus_terms;
+        std::vector<std::pair<PostingListView, double>> plus_postings;
+        std::vector<PostingListView> minus_postings;
+        std::vector<SegmentPostings> segment_postings;
+        std::vector<ScoredTerm> scored_terms;
+        std::vector<PostingCursor> minus_cursors;
+        std::vector<size_t> order;
+        std::vector<Document> matched_documents;
+        ScoreAccumulator accumulator;
+        QueryDeadline deadline;
+    };
+
+    // Берёт свободный контекст из пула потока и возвращает его туда же;
+    // вложенный запрос из того же потока получает другой контекст
+    class QueryContextLease {
+    public:
+        QueryContextLease();
+
+        QueryContextLease(const QueryContextLease&) = delete;
+        QueryContextLease& operator=(const QueryContextLease&) = delete;
+
+        ~QueryContextLease();
+
+        QueryContext& operator*() const {
+            return *context_;
+        }
+
+        QueryContext* operator->() const {
+            return context_.get();
+        }
+
+    private:
+        std::unique_ptr<QueryContext> context_;
+
+        static std::vector<std::unique_ptr<QueryContext>>& GetPool();
+    };
+
+    void ParseQuery(std::string_view text, bool sort, QueryContext& context) const;
+
+    static std::string MakeQueryCacheKey(const Query& query, DocumentStatus status, bool is_sequenced, size_t max_count);
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocumentsByStatus(ExecutionPolicy&& policy, QueryContext& context,
+        DocumentStatus status, size_t max_count) const;
+
+    template <typename DocumentPredicate, typename Execution>
+    std::vector<Document> FindTopDocumentsForQuery(Execution&& policy, const IndexVersion& version, QueryContext& context,
+        DocumentPredicate document_predicate, size_t max_count) const;
+
+    void FindQueryPostings(const IndexVersion& version, QueryContext& context) const;
+
+    // Фильтр по статусу проверяется по битовым картам статусов сегментов, а
+    // сегменты без документов этого статуса пропускаются целиком
+    struct StatusPredicate {
+        DocumentStatus status;
+
+        bool operator()(int, DocumentStatus document_status, int) const {
+            return document_status == status;
+        }
+    };
+
+    template <typename DocumentPredicate>
+    static bool MayAcceptAny(const IndexSegment& segment, const DocumentPredicate& document_predicate);
+
+    template <typename DocumentPredicate>
+    static bool IsAccepted(const IndexSegment& segment, DocumentOrdinal ordinal, DocumentPredicate& document_predicate);
+
+    std::optional<double> FindInverseDocumentFreq(const IndexVersion& version, TermId term_id) const;
+
+    template<typename DocumentPredicate>
+    void FindAllDocuments(const std::execution::sequenced_policy& policy, const IndexVersion& version,
+        const std::vector<SegmentPostings>& segment_postings, QueryDeadlineChecker& deadline_checker,
+        DocumentPredicate document_predicate, ScoreAccumulator& accumulator, std::vector<Document>& matched_documents) const;
+
+    template<typename DocumentPredicate>
+    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy& policy, const IndexVersion& version,
+        const std::vector<SegmentPostings>& segment_postings, const QueryDeadline& deadline,
+        DocumentPredicate document_predicate, size_t max_count_per_partition = std::numeric_limits<size_t>::max()) const;
 
     template<typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+    void ScoreDocumentRange(const IndexVersion& version, const SegmentPostings& segment_postings, QueryDeadlineChecker& deadline_checker,
+        DocumentPredicate& document_predicate, DocumentOrdinal begin, DocumentOrdinal end, ScoreAccumulator& document_to_relevance,
+        std::vector<Document>& matched_documents) const;
+
+    bool IsPruningWorthwhile(const std::vector<SegmentPostings>& segment_postings, size_t max_count) const;
 
     template<typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocumentsPruned(const IndexVersion& version, QueryContext& context,
+        DocumentPredicate document_predicate, size_t max_count) const;
 
     template<typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    void CollectTopDocumentsPruned(const IndexVersion& version, const SegmentPostings& segment_postings, QueryContext& context,
+        QueryDeadlineChecker& deadline_checker, DocumentPredicate& document_predicate, TopDocumentsCollector& collector) const;
 
-    double ComputeWordFreq(std::string_view word) const;
+    static double ComputeWordFreq(size_t document_count, size_t document_freq);
+
+    static bool ContainsTerm(WordFreqs word_freqs, TermId term_id);
 };
 
+inline bool SearchServer::RemovedDocuments::IsRemoved(DocumentOrdinal ordinal) const {
+    return (ordinals.Get(ordinal / 64) >> (ordinal % 64)) & 1;
+}
+
+inline void SearchServer::RemovedDocuments::SetRemoved(DocumentOrdinal ordinal, bool is_removed) {
+    const uint64_t bit = uint64_t{ 1 } << (ordinal % 64);
+    const uint64_t word = ordinals.Get(ordinal / 64);
+    ordinals.Set(ordinal / 64, is_removed ? word | bit : word & ~bit);
+}
+
 template <typename StringContainer>
 SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(CheckString(stop_words))
+    : removed_(std::make_shared<RemovedDocuments>())
+    , document_ordinals_(std::make_shared<DocumentOrdinals>())
+    , stop_words_(CheckString(stop_words))
 {
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
         throw std::invalid_argument("слово содержит специальный символ"s);
     }
+    PublishVersion();
 }
 
 template <typename DocumentPredicate, typename Execution>
-std::vector<Document> SearchServer::FindTopDocuments(Execution&& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    auto matched_documents = FindAllDocuments(policy, raw_query, document_predicate);
-
-    std::sort(policy,
-        matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
+std::vector<Document> SearchServer::FindTopDocuments(Execution&& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t max_count) const {
+    const QueryContextLease context;
+    ParseQuery(raw_query, true, *context);
+    return FindTopDocumentsForQuery(policy, *LoadVersion(), *context, document_predicate, max_count);
+}
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename DocumentPredicate, typename Execution>
+std::vector<Document> SearchServer::FindTopDocumentsForQuery(Execution&& policy, const IndexVersion& version, QueryContext& context,
+    DocumentPredicate document_predicate, size_t max_count) const {
+    context.deadline.Check();
+    FindQueryPostings(version, context);
+    const std::vector<SegmentPostings>& segment_postings = context.segment_postings;
+
+    if constexpr (std::is_same_v<std::decay_t<Execution>, std::execution::sequenced_policy>) {
+        if (IsPruningWorthwhile(segment_postings, max_count)) {
+            return FindTopDocumentsPruned(version, context, document_predicate, max_count);
+        }
+        // Кандидаты набираются в буфер контекста, наружу копируются лучшие
+        std::vector<Document>& matched_documents = context.matched_documents;
+        matched_documents.clear();
+        QueryDeadlineChecker deadline_checker(context.deadline);
+        FindAllDocuments(policy, version, segment_postings, deadline_checker, document_predicate, context.accumulator,
+            matched_documents);
+        SelectTopDocuments(policy, matched_documents, max_count);
+        return { matched_documents.begin(), matched_documents.end() };
+    }
+    else {
+        std::vector<Document> matched_documents = FindAllDocuments(policy, version, segment_postings, context.deadline,
+            document_predicate, max_count);
+        SelectTopDocuments(policy, matched_documents, max_count);
+        return matched_documents;
     }
+}
 
-    return matched_documents;
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t max_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, max_count);
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocumentsWithDeadline(const QueryDeadline& deadline, std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t max_count) const {
+    const QueryContextLease context;
+    context->deadline = deadline;
+    ParseQuery(raw_query, true, *context);
+    return FindTopDocumentsForQuery(std::execution::seq, *LoadVersion(), *context, document_predicate, max_count);
 }
 
 template <typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query,
-        [&status](int document_id, DocumentStatus new_status, int rating) {
-            return new_status == status;
-        });
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status,
+    size_t max_count) const {
+    const QueryContextLease context;
+    ParseQuery(raw_query, true, *context);
+    return FindTopDocumentsByStatus(policy, *context, status, max_count);
+}
+
+// Результат берётся из кеша, если он посчитан на той же версии индекса
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocumentsByStatus(ExecutionPolicy&& policy, QueryContext& context,
+    DocumentStatus status, size_t max_count) const {
+    const StatusPredicate status_predicate{ status };
+    const auto version = LoadVersion();
+    if (!query_cache_.IsEnabled()) {
+        return FindTopDocumentsForQuery(policy, *version, context, status_predicate, max_count);
+    }
+
+    std::string key = MakeQueryCacheKey(context.query, status,
+        std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>, max_count);
+    if (auto documents = query_cache_.Find(key, version->generation)) {
+        return std::move(*documents);
+    }
+    auto documents = FindTopDocumentsForQuery(policy, *version, context, status_predicate, max_count);
+    query_cache_.Insert(std::move(key), version->generation, documents);
+    return documents;
 }
 
 template <typename ExecutionPolicy>
@@ -173,127 +594,461 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, s
 }
 
 template<typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(raw_query,true);
-    std::map<int, double> document_to_relevance;
+void SearchServer::FindAllDocuments(const std::execution::sequenced_policy&, const IndexVersion& version,
+    const std::vector<SegmentPostings>& segment_postings, QueryDeadlineChecker& deadline_checker,
+    DocumentPredicate document_predicate, ScoreAccumulator& accumulator, std::vector<Document>& matched_documents) const {
+    for (const SegmentPostings& segment : segment_postings) {
+        ScoreDocumentRange(version, segment, deadline_checker, document_predicate,
+            segment.segment->GetFirstOrdinal(), segment.segment->GetEndOrdinal(), accumulator, matched_documents);
+    }
+}
 
-    for (auto word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordFreq(word);
-        for (auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const DocumentData& documents_data = documents_.at(document_id);
-            if (document_predicate(document_id, documents_data.status, documents_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
-            }
-        }
+// Документы сегментов, где есть слова запроса, делятся поровну на
+// непересекающиеся диапазоны (номера между сегментами, оставшиеся от слияний,
+// не считаются), каждый из которых целиком обсчитывается одним потоком в
+// аккумуляторе контекста, взятого этим потоком (по кускам, приходящимся на
+// разные сегменты), поэтому синхронизация между потоками не нужна. Если задан
+// max_count_per_partition, каждый диапазон сразу оставляет только свои лучшие
+// документы, и общий отбор идёт среди них. Исключение из параллельного
+// алгоритма завершило бы программу, поэтому истечение срока запоминается
+// диапазоном и бросается после обхода.
+template<typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy& policy, const IndexVersion& version,
+    const std::vector<SegmentPostings>& segment_postings, const QueryDeadline& deadline,
+    DocumentPredicate document_predicate, size_t max_count_per_partition) const {
+    size_t ordinal_count = 0;
+    for (const SegmentPostings& segment : segment_postings) {
+        ordinal_count += segment.segment->GetEndOrdinal() - segment.segment->GetFirstOrdinal();
     }
+    const size_t partition_count = std::min<size_t>(std::max(ordinal_count, size_t{ 1 }),
+        std::max(1u, std::thread::hardware_concurrency()) * PARTITIONS_PER_THREAD);
+
+    std::vector<std::vector<Document>> partition_documents(partition_count);
+    std::vector<std::exception_ptr> partition_errors(partition_count);
+    std::vector<size_t> partitions(partition_count);
+    std::iota(partitions.begin(), partitions.end(), 0);
+
+    std::for_each(policy, partitions.begin(), partitions.end(),
+        [&](size_t partition) {
+            const size_t begin = partition * ordinal_count / partition_count;
+            const size_t end = (partition + 1) * ordinal_count / partition_count;
+            auto predicate = document_predicate;
+            const QueryContextLease partition_context;
+            QueryDeadlineChecker deadline_checker(deadline);
+            std::vector<Document>& matched_documents = partition_documents[partition];
+            try {
+                size_t segment_begin = 0;
+                for (const SegmentPostings& segment : segment_postings) {
+                    const DocumentOrdinal first_ordinal = segment.segment->GetFirstOrdinal();
+                    const size_t segment_end = segment_begin + (segment.segment->GetEndOrdinal() - first_ordinal);
+                    if (segment_begin < end && begin < segment_end) {
+                        ScoreDocumentRange(version, segment, deadline_checker, predicate,
+                            first_ordinal + static_cast<DocumentOrdinal>(std::max(begin, segment_begin) - segment_begin),
+                            first_ordinal + static_cast<DocumentOrdinal>(std::min(end, segment_end) - segment_begin),
+                            partition_context->accumulator, matched_documents);
+                    }
+                    segment_begin = segment_end;
+                }
+            }
+            catch (...) {
+                partition_errors[partition] = std::current_exception();
+                return;
+            }
+            if (matched_documents.size() > max_count_per_partition) {
+                SelectTopDocuments(std::execution::seq, matched_documents, max_count_per_partition);
+            }
+        });
 
-    for (auto word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+    for (const std::exception_ptr& error : partition_errors) {
+        if (error) {
+            std::rethrow_exception(error);
         }
     }
 
     std::vector<Document> matched_documents;
-    for (auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+    for (const auto& documents : partition_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
     }
     return matched_documents;
 }
 
 template<typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    const auto query = ParseQuery(raw_query,true);
+void SearchServer::ScoreDocumentRange(const IndexVersion& version, const SegmentPostings& segment_postings, QueryDeadlineChecker& deadline_checker,
+    DocumentPredicate& document_predicate, DocumentOrdinal begin, DocumentOrdinal end, ScoreAccumulator& document_to_relevance,
+    std::vector<Document>& matched_documents) const {
+    const IndexSegment& segment = *segment_postings.segment;
+    const QueryPostings& query_postings = segment_postings.postings;
+    if (!MayAcceptAny(segment, document_predicate)) {
+        return;
+    }
+    document_to_relevance.Reset(end - begin);
 
-    for (auto word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    for (const PostingListView& postings : query_postings.minus_postings) {
+        postings.ForEachInRange(begin, end, [&](DocumentOrdinal ordinal, double) {
+            deadline_checker.Poll();
+            document_to_relevance.Exclude(ordinal - begin);
+        });
+    }
+
+    for (const auto& [postings, inverse_document_freq] : query_postings.plus_postings) {
+        postings.ForEachInRange(begin, end, [&, inverse_document_freq = inverse_document_freq](DocumentOrdinal ordinal, double term_freq) {
+            deadline_checker.Poll();
+            const auto state = document_to_relevance.GetState(ordinal - begin);
+            if (state == ScoreAccumulator::State::EXCLUDED) {
+                return;
+            }
+            if (state == ScoreAccumulator::State::UNTOUCHED) {
+                if (version.removed->IsRemoved(ordinal) || !IsAccepted(segment, ordinal, document_predicate)) {
+                    document_to_relevance.Exclude(ordinal - begin);
+                    return;
+                }
+            }
+            document_to_relevance.Add(ordinal - begin, term_freq * inverse_document_freq);
+        });
+    }
+
+    document_to_relevance.ForEachScored([&](DocumentOrdinal local_ordinal, double relevance) {
+        const DocumentOrdinal ordinal = begin + local_ordinal;
+        matched_documents.push_back({ segment.GetDocumentId(ordinal), relevance, segment.GetRating(ordinal) });
+    });
+}
+
+// Block-Max WAND: документы перебираются по возрастанию внутреннего номера,
+// и документ оценивается, только если верхняя граница его релевантности
+// (сначала по максимальным частотам слов во всём списке, затем по максимумам
+// текущих блоков) позволяет ему попасть в уже набранные max_count лучших.
+// Релевантность суммируется в том же порядке слов, что и при полном переборе,
+// поэтому результат совпадает с ним. Сегменты обходятся по очереди с общим
+// набором лучших документов, так что порог отсечения переносится между ними.
+template<typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsPruned(const IndexVersion& version, QueryContext& context,
+    DocumentPredicate document_predicate, size_t max_count) const {
+    TopDocumentsCollector collector(max_count);
+    QueryDeadlineChecker deadline_checker(context.deadline);
+    for (const SegmentPostings& segment : context.segment_postings) {
+        CollectTopDocumentsPruned(version, segment, context, deadline_checker, document_predicate, collector);
+    }
+    return collector.ExtractSorted();
+}
+
+template<typename DocumentPredicate>
+void SearchServer::CollectTopDocumentsPruned(const IndexVersion& version, const SegmentPostings& segment_postings, QueryContext& context,
+    QueryDeadlineChecker& deadline_checker, DocumentPredicate& document_predicate, TopDocumentsCollector& collector) const {
+    const IndexSegment& segment = *segment_postings.segment;
+    const QueryPostings& query_postings = segment_postings.postings;
+    if (!MayAcceptAny(segment, document_predicate)) {
+        return;
+    }
+
+    std::vector<ScoredTerm>& terms = context.scored_terms;
+    terms.clear();
+    for (const auto& [postings, inverse_document_freq] : query_postings.plus_postings) {
+        terms.push_back({ PostingCursor(postings), inverse_document_freq, postings.GetMaxTermFreq() * inverse_document_freq });
+    }
+
+    std::vector<PostingCursor>& minus_cursors = context.minus_cursors;
+    minus_cursors.clear();
+    for (const PostingListView& postings : query_postings.minus_postings) {
+        minus_cursors.emplace_back(postings);
+    }
+
+    const auto can_skip = [&collector](double upper_bound) {
+        return collector.IsFull() && upper_bound < collector.GetWorst().relevance - EPSILON;
+    };
+
+    std::vector<size_t>& order = context.order;
+    order.resize(terms.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    while (true) {
+        deadline_checker.Poll();
+        order.erase(std::remove_if(order.begin(), order.end(), [&terms](size_t index) {
+            return terms[index].cursor.IsEnd();
+            }), order.end());
+        std::sort(order.begin(), order.end(), [&terms](size_t lhs, size_t rhs) {
+            return terms[lhs].cursor.GetOrdinal() < terms[rhs].cursor.GetOrdinal();
+            });
+
+        size_t pivot = 0;
+        double upper_bound = 0.0;
+        for (; pivot < order.size(); ++pivot) {
+            upper_bound += terms[order[pivot]].upper_bound;
+            if (!can_skip(upper_bound)) {
+                break;
+            }
         }
-        const double inverse_document_freq = ComputeWordFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        if (pivot == order.size()) {
+            break;
+        }
+
+        const DocumentOrdinal pivot_ordinal = terms[order[pivot]].cursor.GetOrdinal();
+        while (pivot + 1 < order.size() && terms[order[pivot + 1]].cursor.GetOrdinal() == pivot_ordinal) {
+            ++pivot;
+        }
+
+        double block_upper_bound = 0.0;
+        uint64_t next_ordinal = pivot + 1 < order.size()
+            ? terms[order[pivot + 1]].cursor.GetOrdinal()
+            : uint64_t{ std::numeric_limits<DocumentOrdinal>::max() } + 1;
+        for (size_t i = 0; i <= pivot; ++i) {
+            const ScoredTerm& term = terms[order[i]];
+            const PostingBlockBound bound = term.cursor.PeekBlock(pivot_ordinal);
+            block_upper_bound += bound.max_term_freq * term.inverse_document_freq;
+            next_ordinal = std::min(next_ordinal, uint64_t{ bound.last_ordinal } + 1);
+        }
+
+        if (can_skip(block_upper_bound)) {
+            for (size_t i = 0; i <= pivot; ++i) {
+                PostingCursor& cursor = terms[order[i]].cursor;
+                if (next_ordinal > std::numeric_limits<DocumentOrdinal>::max()) {
+                    while (!cursor.IsEnd()) {
+                        cursor.Next();
+                    }
+                }
+                else {
+                    cursor.Advance(static_cast<DocumentOrdinal>(next_ordinal));
+                }
             }
+            continue;
         }
-    }
 
-    for (auto word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        if (terms[order[0]].cursor.GetOrdinal() != pivot_ordinal) {
+            for (size_t i = 0; i < pivot; ++i) {
+                terms[order[i]].cursor.Advance(pivot_ordinal);
+            }
             continue;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+
+        const bool is_excluded = version.removed->IsRemoved(pivot_ordinal)
+            || std::any_of(minus_cursors.begin(), minus_cursors.end(), [pivot_ordinal](PostingCursor& cursor) {
+                cursor.Advance(pivot_ordinal);
+                return !cursor.IsEnd() && cursor.GetOrdinal() == pivot_ordinal;
+                });
+        if (!is_excluded && IsAccepted(segment, pivot_ordinal, document_predicate)) {
+            const int document_id = segment.GetDocumentId(pivot_ordinal);
+            const int rating = segment.GetRating(pivot_ordinal);
+            double relevance = 0.0;
+            for (const ScoredTerm& term : terms) {
+                if (!term.cursor.IsEnd() && term.cursor.GetOrdinal() == pivot_ordinal) {
+                    relevance += term.cursor.GetTermFreq() * term.inverse_document_freq;
+                }
+            }
+            collector.Add({ document_id, relevance, rating });
+        }
+
+        for (size_t i = 0; i <= pivot; ++i) {
+            terms[order[i]].cursor.Next();
         }
     }
+}
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+template <typename DocumentPredicate>
+bool SearchServer::MayAcceptAny(const IndexSegment& segment, const DocumentPredicate& document_predicate) {
+    if constexpr (std::is_same_v<std::decay_t<DocumentPredicate>, StatusPredicate>) {
+        return segment.GetStatusCount(document_predicate.status) > 0;
+    }
+    else {
+        return true;
     }
-    return matched_documents;
 }
 
-template<typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(16);
-    const auto query = ParseQuery(raw_query,true);
-
-    std::for_each(policy, query.minus_words.begin(), query.minus_words.end(),
-        [this, &document_to_relevance](std::string_view word) {
-            if (word_to_document_freqs_.count(word)) {
-                for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                    document_to_relevance.Erase(document_id);
-                }
+template <typename DocumentPredicate>
+bool SearchServer::IsAccepted(const IndexSegment& segment, DocumentOrdinal ordinal, DocumentPredicate& document_predicate) {
+    if constexpr (std::is_same_v<std::decay_t<DocumentPredicate>, StatusPredicate>) {
+        return segment.HasStatus(ordinal, document_predicate.status);
+    }
+    else {
+        return document_predicate(segment.GetDocumentId(ordinal), segment.GetStatus(ordinal), segment.GetRating(ordinal));
+    }
+}
+
+// Строки пишутся подряд одним массивом символов и массивом смещений
+template <typename StringContainer>
+void SearchServer::WriteStrings(IndexFileWriter& writer, const StringContainer& strings) {
+    std::vector<char> chars;
+    std::vector<uint64_t> offsets(1, 0);
+    for (const std::string_view string : strings) {
+        chars.insert(chars.end(), string.begin(), string.end());
+        offsets.push_back(chars.size());
+    }
+    writer.WriteArray(chars.data(), chars.size());
+    writer.WriteArray(offsets.data(), offsets.size());
+}
+
+// Удаление только отмечает документ в RemovedDocuments, поэтому делить
+// эту работу между потоками незачем
+template <typename Execution>
+void SearchServer::RemoveDocument(Execution&&, int document_id) {
+    RemoveDocument(document_id);
+}
+
+// Пакет проверяется целиком до изменения индекса: при ошибке не добавляется
+// ни один документ. Токенизация и построение частичных индексов идут по
+// диапазонам пакета параллельно; затем слова диапазонов по порядку заносятся
+// в словарь, и список вхождений каждого слова строится за один проход.
+// Весь пакет становится одним новым сегментом.
+template <typename ExecutionPolicy>
+void SearchServer::AddDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents) {
+    std::lock_guard lock(write_mutex_);
+    std::vector<int> batch_ids;
+    batch_ids.reserve(documents.size());
+    for (const NewDocument& document : documents) {
+        CheckNewDocumentId(document.id);
+        batch_ids.push_back(document.id);
+    }
+    std::sort(batch_ids.begin(), batch_ids.end());
+    if (std::adjacent_find(batch_ids.begin(), batch_ids.end()) != batch_ids.end()) {
+        throw std::invalid_argument("Попытка добавить документ c id ранее добавленного документа!");
+    }
+
+    struct BatchDocument {
+        TokenizedDocument tokens;
+        std::vector<uint32_t> slots;
+        std::exception_ptr error;
+    };
+
+    if (documents.empty()) {
+        return;
+    }
+
+    std::vector<BatchDocument> batch(documents.size());
+    std::transform(policy, documents.begin(), documents.end(), batch.begin(),
+        [this](const NewDocument& document) {
+            BatchDocument result;
+            try {
+                result.tokens = TokenizeDocument(document.text);
+            }
+            catch (...) {
+                result.error = std::current_exception();
             }
+            return result;
         });
+    for (const BatchDocument& document : batch) {
+        if (document.error) {
+            std::rethrow_exception(document.error);
+        }
+    }
 
-    std::for_each(policy, query.plus_words.begin(), query.plus_words.end(),
-        [this, &document_predicate, &document_to_relevance](std::string_view word) {
-            if (word_to_document_freqs_.count(word)) {
-                const double inverse_document_freq = ComputeWordFreq(word);
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                    }
+    struct PartialIndex {
+        size_t begin = 0;
+        size_t end = 0;
+        std::unordered_map<std::string_view, uint32_t> word_to_slot;
+        std::vector<std::string_view> words;
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> postings;
+        std::vector<TermId> term_ids;
+    };
+
+    size_t partition_count = 1;
+    if constexpr (!std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        partition_count = std::min<size_t>(std::max(documents.size(), size_t{ 1 }),
+            std::max(1u, std::thread::hardware_concurrency()) * PARTITIONS_PER_THREAD);
+    }
+
+    std::vector<PartialIndex> partials(partition_count);
+    for (size_t partition = 0; partition < partition_count; ++partition) {
+        partials[partition].begin = partition * documents.size() / partition_count;
+        partials[partition].end = (partition + 1) * documents.size() / partition_count;
+    }
+
+    std::for_each(policy, partials.begin(), partials.end(), [&batch](PartialIndex& partial) {
+        for (size_t index = partial.begin; index < partial.end; ++index) {
+            BatchDocument& document = batch[index];
+            document.slots.reserve(document.tokens.word_counts.size());
+            for (const auto& [word, count] : document.tokens.word_counts) {
+                const auto [it, inserted] = partial.word_to_slot.try_emplace(word, static_cast<uint32_t>(partial.words.size()));
+                if (inserted) {
+                    partial.words.push_back(word);
+                    partial.postings.emplace_back();
                 }
+                partial.postings[it->second].emplace_back(static_cast<uint32_t>(index), count);
+                document.slots.push_back(it->second);
             }
+        }
+        partial.word_to_slot.clear();
         });
 
-    std::map<int, double> document_to_relevance_reduced = document_to_relevance.BuildOrdinaryMap();
-    std::vector<Document> matched_documents;
-    matched_documents.reserve(document_to_relevance_reduced.size());
+    // Записи (слово, диапазон, ячейка) после устойчивой сортировки по слову
+    // идут в порядке диапазонов, то есть по возрастанию номеров документов
+    struct TermSource {
+        TermId term_id;
+        uint32_t partition;
+        uint32_t slot;
+    };
 
-    for (const auto [document_id, relevance] : document_to_relevance_reduced) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+    std::vector<TermSource> sources;
+    for (size_t partition = 0; partition < partition_count; ++partition) {
+        PartialIndex& partial = partials[partition];
+        partial.term_ids.reserve(partial.words.size());
+        for (size_t slot = 0; slot < partial.words.size(); ++slot) {
+            const TermId term_id = terms_.Intern(partial.words[slot]);
+            partial.term_ids.push_back(term_id);
+            sources.push_back({ term_id, static_cast<uint32_t>(partition), static_cast<uint32_t>(slot) });
+        }
     }
-    return matched_documents;
-}
+    std::stable_sort(policy, sources.begin(), sources.end(), [](const TermSource& lhs, const TermSource& rhs) {
+        return lhs.term_id < rhs.term_id;
+        });
 
-template <typename Execution>
-void SearchServer::RemoveDocument(Execution&& value, int document_id) {
+    struct TermGroup {
+        size_t start = 0;
+        PostingList postings;
+    };
 
-    if (document_to_word_freqs_.count(document_id)) {
-        const std::map<std::string_view, double>& word_freqs = document_to_word_freqs_.at(document_id);
-        std::vector<std::string*> words(word_freqs.size());
+    std::vector<TermGroup> groups;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (i == 0 || sources[i].term_id != sources[i - 1].term_id) {
+            groups.push_back({ i, PostingList() });
+        }
+    }
 
-        std::transform(value, word_freqs.begin(), word_freqs.end(), words.begin(), []
-        (const auto& item) { return &item.first; }
-        );
+    SealHeadSegment();
+    const DocumentOrdinal first_ordinal = next_ordinal_;
+    std::for_each(policy, groups.begin(), groups.end(), [&](TermGroup& group) {
+        const TermId term_id = sources[group.start].term_id;
+        for (size_t i = group.start; i < sources.size() && sources[i].term_id == term_id; ++i) {
+            for (const auto& [index, count] : partials[sources[i].partition].postings[sources[i].slot]) {
+                group.postings.Append(first_ordinal + index, count, batch[index].tokens.length);
+            }
+        }
+        });
 
-        std::for_each(value, words.begin(), words.end(), [this, document_id](std::string* item) {
-            word_to_document_freqs_.at(*item).erase(document_id);
-            });
+    // Прямые списки всех документов пакета лежат подряд в одном массиве
+    std::vector<size_t> word_freq_offsets(documents.size() + 1, 0);
+    size_t text_size = 0;
+    for (size_t index = 0; index < documents.size(); ++index) {
+        word_freq_offsets[index + 1] = word_freq_offsets[index] + batch[index].slots.size();
+        text_size += documents[index].text.size();
+    }
+    std::vector<WordFreq> word_freqs(word_freq_offsets.back());
+    std::for_each(policy, partials.begin(), partials.end(), [&](const PartialIndex& partial) {
+        for (size_t index = partial.begin; index < partial.end; ++index) {
+            const BatchDocument& document = batch[index];
+            WordFreq* freqs = word_freqs.data() + word_freq_offsets[index];
+            for (size_t i = 0; i < document.slots.size(); ++i) {
+                freqs[i] = { partial.term_ids[document.slots[i]],
+                    ComputeTermFreq(document.tokens.word_counts[i].second, document.tokens.length) };
+            }
+            std::sort(freqs, freqs + document.slots.size());
+        }
+        });
+
+    IndexSegment segment(first_ordinal);
+    segment.Reserve(documents.size(), text_size, word_freqs.size());
+    for (size_t index = 0; index < documents.size(); ++index) {
+        const NewDocument& document = documents[index];
+        segment.AddDocument(document.id, ComputeAverageRating(document.ratings), document.status, document.text,
+            { word_freqs.data() + word_freq_offsets[index], word_freqs.data() + word_freq_offsets[index + 1] });
+    }
+    for (const TermGroup& group : groups) {
+        segment.AddPostings(sources[group.start].term_id, group.postings);
+    }
+    segment.Seal();
 
-        document_to_word_freqs_.erase(document_id);
-        documents_.erase(document_id);
-        document_ids_.erase(document_id);
+    DocumentOrdinals& document_ordinals = GetMutableDocumentOrdinals();
+    for (size_t index = 0; index < documents.size(); ++index) {
+        document_ordinals.Set(documents[index].id, first_ordinal + static_cast<DocumentOrdinal>(index));
     }
+    document_count_ += documents.size();
+    next_ordinal_ += static_cast<DocumentOrdinal>(documents.size());
+    AddSegment(std::move(segment));
 }
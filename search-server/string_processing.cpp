@@ -1,5 +1,13 @@
 #include "string_processing.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRING_PROCESSING_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 std::vector<std::string> SplitIntoWords(const std::string& text) {
     std::vector<std::string> words;
     std::string word;
@@ -21,22 +29,94 @@ std::vector<std::string> SplitIntoWords(const std::string& text) {
     return words;
 }
 
-std::vector<std::string_view> SplitIntoWordsView(std::string_view str) {
-
-    std::vector<std::string_view> result;
+namespace {
 
-    str.remove_prefix(std::min(str.find_first_not_of(' '), str.size()));
-    const std::string_view::size_type pos_end = std::string_view::npos;
-
-    while (!str.empty()) {
+bool IsControl(char symbol) {
+    return symbol >= '\0' && symbol < ' ';
+}
 
-        std::string_view::size_type space = str.find(' ');
+#ifdef STRING_PROCESSING_SSE2
+unsigned CountTrailingZeros(unsigned value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+}
+#endif
 
-        result.push_back(space == pos_end ? str.substr(0, str.size()) : str.substr(0, space));
+// Один проход по тексту: границы слов и управляющие символы ищутся сразу по
+// 16 байт — из сравнений получаются битовые маски непробельных и управляющих
+// символов, а начала и концы слов — это смены бита в маске непробельных.
+// Хвост короче 16 байт и платформы без SSE2 обрабатываются посимвольно.
+bool SplitWords(std::string_view text, std::vector<std::string_view>& words, bool check_control) {
+    const char* const data = text.data();
+    const size_t size = text.size();
+    size_t word_start = 0;
+    bool in_word = false;
+    size_t position = 0;
 
-        str.remove_prefix(std::min(str.find_first_not_of(' ', space), str.size()));
+#ifdef STRING_PROCESSING_SSE2
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i minus_one = _mm_set1_epi8(-1);
+    for (; position + 16 <= size; position += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+        if (check_control) {
+            const __m128i control = _mm_and_si128(_mm_cmplt_epi8(block, spaces), _mm_cmpgt_epi8(block, minus_one));
+            if (_mm_movemask_epi8(control) != 0) {
+                return false;
+            }
+        }
+        const unsigned letters = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, spaces))) & 0xFFFFu;
+        const unsigned previous = (letters << 1 | (in_word ? 1u : 0u)) & 0xFFFFu;
+        unsigned changes = letters ^ previous;
+        while (changes != 0) {
+            const unsigned bit = changes & (0u - changes);
+            const size_t offset = CountTrailingZeros(changes);
+            if (letters & bit) {
+                word_start = position + offset;
+            }
+            else {
+                words.emplace_back(data + word_start, position + offset - word_start);
+            }
+            changes ^= bit;
+        }
+        in_word = (letters & 0x8000u) != 0;
+    }
+#endif
 
+    for (; position < size; ++position) {
+        const char symbol = data[position];
+        if (check_control && IsControl(symbol)) {
+            return false;
+        }
+        if (symbol == ' ') {
+            if (in_word) {
+                words.emplace_back(data + word_start, position - word_start);
+                in_word = false;
+            }
+        }
+        else if (!in_word) {
+            word_start = position;
+            in_word = true;
+        }
+    }
+    if (in_word) {
+        words.emplace_back(data + word_start, size - word_start);
     }
+    return true;
+}
 
+}  // namespace
+
+std::vector<std::string_view> SplitIntoWordsView(std::string_view str) {
+    std::vector<std::string_view> result;
+    SplitWords(str, result, false);
     return result;
-}
\ No newline at end of file
+}
+
+bool SplitIntoValidWordsView(std::string_view text, std::vector<std::string_view>& words) {
+    return SplitWords(text, words, true);
+}
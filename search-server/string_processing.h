@@ -3,11 +3,17 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <string_view>
 
 std::vector<std::string> SplitIntoWords(const std::string& text);
 
 std::vector<std::string_view> SplitIntoWordsView(std::string_view str);
 
+// Дописывает в words слова текста, разделённые пробелами, и за тот же проход
+// проверяет, что в тексте нет управляющих символов (коды 0-31). При первом
+// таком символе возвращает false, оставляя words в неопределённом состоянии.
+bool SplitIntoValidWordsView(std::string_view text, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> CheckString(const StringContainer& strings) {
     std::set<std::string, std::less<>> result;
@@ -0,0 +1,147 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <functional>
+
+TermDictionary::TermDictionary() {
+    directories_.push_back(std::make_unique<Directory>());
+    directory_.store(directories_.back().get(), std::memory_order_release);
+
+    auto table = std::make_unique<HashTable>();
+    table->mask = 15;
+    table->slots = std::make_unique<std::atomic<TermId>[]>(table->mask + 1);
+    tables_.push_back(std::move(table));
+    table_.store(tables_.back().get(), std::memory_order_release);
+}
+
+TermId TermDictionary::Intern(std::string_view term) {
+    if (const auto term_id = FindTerm(term)) {
+        return *term_id;
+    }
+
+    const size_t term_count = term_count_.load(std::memory_order_relaxed);
+    const auto term_id = static_cast<TermId>(term_count);
+    if (term_count % CHUNK_SIZE == 0) {
+        if (term_count / CHUNK_SIZE == directory_.load(std::memory_order_relaxed)->capacity) {
+            GrowDirectory();
+        }
+        chunks_.push_back(std::make_unique<Term[]>(CHUNK_SIZE));
+        directory_.load(std::memory_order_relaxed)->chunks[term_count / CHUNK_SIZE].store(chunks_.back().get(), std::memory_order_release);
+    }
+    chunks_[term_count / CHUNK_SIZE][term_count % CHUNK_SIZE].text = StoreText(term);
+
+    if ((term_count + 1) * 2 > table_.load(std::memory_order_relaxed)->mask + 1) {
+        GrowTable();
+    }
+    InsertSlot(*table_.load(std::memory_order_relaxed), term, term_id);
+    term_count_.store(term_count + 1, std::memory_order_release);
+
+    return term_id;
+}
+
+std::optional<TermId> TermDictionary::FindTerm(std::string_view term) const {
+    const HashTable& table = *table_.load(std::memory_order_acquire);
+    for (size_t slot = std::hash<std::string_view>{}(term) & table.mask;; slot = (slot + 1) & table.mask) {
+        const TermId value = table.slots[slot].load(std::memory_order_acquire);
+        if (value == 0) {
+            return std::nullopt;
+        }
+        if (GetTerm(value - 1) == term) {
+            return value - 1;
+        }
+    }
+}
+
+std::string_view TermDictionary::GetTerm(TermId term_id) const {
+    return GetTermSlot(term_id).text;
+}
+
+size_t TermDictionary::GetTermCount() const {
+    return term_count_.load(std::memory_order_acquire);
+}
+
+// Значение читается как под seqlock: если отметка до и после чтения одна и
+// та же и совпадает с нужной версией, значение записано для этой версии
+std::optional<double> TermDictionary::FindCachedValue(TermId term_id, uint64_t version) const {
+    const Term& term = GetTermSlot(term_id);
+    const uint64_t stamp = term.value_stamp.load(std::memory_order_acquire);
+    if (stamp != version + 1) {
+        return std::nullopt;
+    }
+    const double value = term.value.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (term.value_stamp.load(std::memory_order_relaxed) != stamp) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+void TermDictionary::CacheValue(TermId term_id, uint64_t version, double value) const {
+    const Term& term = GetTermSlot(term_id);
+    uint64_t stamp = term.value_stamp.load(std::memory_order_relaxed);
+    if (stamp == VALUE_LOCKED || !term.value_stamp.compare_exchange_strong(stamp, VALUE_LOCKED, std::memory_order_relaxed)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    term.value.store(value, std::memory_order_relaxed);
+    term.value_stamp.store(version + 1, std::memory_order_release);
+}
+
+const TermDictionary::Term& TermDictionary::GetTermSlot(TermId term_id) const {
+    const Directory& directory = *directory_.load(std::memory_order_acquire);
+    const Term* chunk = directory.chunks[term_id / CHUNK_SIZE].load(std::memory_order_acquire);
+    return chunk[term_id % CHUNK_SIZE];
+}
+
+// Слова дописываются в конец текущего блока пула; слово длиннее блока
+// получает отдельный блок, а остаток текущего при этом не теряется
+std::string_view TermDictionary::StoreText(std::string_view term) {
+    char* text = nullptr;
+    if (term.size() > TEXT_BLOCK_SIZE) {
+        auto block = std::make_unique<char[]>(term.size());
+        text = block.get();
+        text_blocks_.insert(text_blocks_.end() - (text_blocks_.empty() ? 0 : 1), std::move(block));
+    }
+    else {
+        if (term.size() > text_block_free_) {
+            text_blocks_.push_back(std::make_unique<char[]>(TEXT_BLOCK_SIZE));
+            text_block_free_ = TEXT_BLOCK_SIZE;
+        }
+        text = text_blocks_.back().get() + (TEXT_BLOCK_SIZE - text_block_free_);
+        text_block_free_ -= term.size();
+    }
+    std::copy(term.begin(), term.end(), text);
+    return { text, term.size() };
+}
+
+void TermDictionary::GrowDirectory() {
+    const Directory& old_directory = *directory_.load(std::memory_order_relaxed);
+    auto directory = std::make_unique<Directory>();
+    directory->capacity = std::max<size_t>(16, old_directory.capacity * 2);
+    directory->chunks = std::make_unique<std::atomic<const Term*>[]>(directory->capacity);
+    for (size_t i = 0; i < old_directory.capacity; ++i) {
+        directory->chunks[i].store(old_directory.chunks[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    directories_.push_back(std::move(directory));
+    directory_.store(directories_.back().get(), std::memory_order_release);
+}
+
+void TermDictionary::GrowTable() {
+    auto table = std::make_unique<HashTable>();
+    table->mask = (table_.load(std::memory_order_relaxed)->mask + 1) * 2 - 1;
+    table->slots = std::make_unique<std::atomic<TermId>[]>(table->mask + 1);
+    const size_t term_count = term_count_.load(std::memory_order_relaxed);
+    for (size_t term_id = 0; term_id < term_count; ++term_id) {
+        InsertSlot(*table, GetTerm(static_cast<TermId>(term_id)), static_cast<TermId>(term_id));
+    }
+    tables_.push_back(std::move(table));
+    table_.store(tables_.back().get(), std::memory_order_release);
+}
+
+void TermDictionary::InsertSlot(const HashTable& table, std::string_view term, TermId term_id) {
+    size_t slot = std::hash<std::string_view>{}(term) & table.mask;
+    while (table.slots[slot].load(std::memory_order_relaxed) != 0) {
+        slot = (slot + 1) & table.mask;
+    }
+    table.slots[slot].store(term_id + 1, std::memory_order_release);
+}
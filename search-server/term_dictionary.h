@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using TermId = uint32_t;
+
+// Интернирует слова индекса: каждому слову один раз выдаётся плотный
+// числовой идентификатор, по которому адресуются постинги и прямые списки.
+// Символы слов хранятся в самом словаре, в пуле крупных блоков, поэтому
+// string_view, полученные через GetTerm, остаются валидными всё время жизни
+// словаря, а новое слово почти никогда не требует выделения памяти.
+//
+// Intern вызывает один писатель, FindTerm и GetTerm можно одновременно
+// вызывать из любых потоков без блокировок: строки лежат в кусках, которые
+// не перемещаются, а каталог кусков и хеш-таблица при росте заменяются
+// новыми копиями. Старые копии освобождаются только вместе со словарём.
+//
+// Слова никогда не удаляются, даже когда исчезают из всех документов: их
+// TermId остаются в сегментах, которые ещё читают старые версии индекса, а
+// их строки — у вызывающих GetTerm. Мёртвые слова отбрасывает
+// SearchServer::Save, поэтому индекс, открытый из файла, их уже не хранит.
+class TermDictionary {
+public:
+    TermDictionary();
+
+    TermDictionary(const TermDictionary&) = delete;
+    TermDictionary& operator=(const TermDictionary&) = delete;
+
+    TermId Intern(std::string_view term);
+
+    std::optional<TermId> FindTerm(std::string_view term) const;
+
+    std::string_view GetTerm(TermId term_id) const;
+
+    size_t GetTermCount() const;
+
+    // Рядом с каждым словом хранится одно число, посчитанное для некоторой
+    // версии индекса, — IDF слова. Его читают и обновляют любые потоки без
+    // блокировок; если два потока обновляют его одновременно, одно из
+    // обновлений просто теряется.
+    std::optional<double> FindCachedValue(TermId term_id, uint64_t version) const;
+
+    void CacheValue(TermId term_id, uint64_t version, double value) const;
+
+private:
+    static constexpr size_t CHUNK_SIZE = 4096;
+    static constexpr size_t TEXT_BLOCK_SIZE = 1 << 16;
+
+    // Отметка — версия + 1; ноль означает отсутствие значения, а
+    // VALUE_LOCKED — что значение прямо сейчас переписывается
+    static constexpr uint64_t VALUE_LOCKED = ~uint64_t{ 0 };
+
+    struct Term {
+        std::string_view text;
+        mutable std::atomic<uint64_t> value_stamp{ 0 };
+        mutable std::atomic<double> value{ 0.0 };
+    };
+
+    struct Directory {
+        size_t capacity = 0;
+        std::unique_ptr<std::atomic<const Term*>[]> chunks;
+    };
+
+    // В ячейке хранится TermId + 1, ноль означает пустую ячейку
+    struct HashTable {
+        size_t mask = 0;
+        std::unique_ptr<std::atomic<TermId>[]> slots;
+    };
+
+    std::vector<std::unique_ptr<Term[]>> chunks_;
+    std::vector<std::unique_ptr<char[]>> text_blocks_;
+    size_t text_block_free_ = 0;
+    std::vector<std::unique_ptr<Directory>> directories_;
+    std::vector<std::unique_ptr<HashTable>> tables_;
+    std::atomic<const Directory*> directory_;
+    std::atomic<const HashTable*> table_;
+    std::atomic<size_t> term_count_{ 0 };
+
+    std::string_view StoreText(std::string_view term);
+
+    const Term& GetTermSlot(TermId term_id) const;
+
+    void GrowDirectory();
+
+    void GrowTable();
+
+    static void InsertSlot(const HashTable& table, std::string_view term, TermId term_id);
+};
@@ -1,4 +1,31 @@
 #include "test_example_functions.h"
+#include "request_queue.h"
+#include "async_search_server.h"
+#include "chunked_hash_map.h"
+#include "concurrent_map.h"
+#include "process_queries.h"
+#include "read_input_functions.h"
+#include "string_processing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string& document, DocumentStatus status, const std::vector<int>& ratings) {
     try {
@@ -48,4 +75,999 @@ void PrintMatchDocumentResult(int document_id, const std::vector<std::string_vie
         std::cout << ' ' << word;
     }
     std::cout << "}"s << std::endl;
+}
+
+namespace {
+
+void AssertImpl(bool value, const std::string& expr_str, const std::string& file, unsigned line, const std::string& hint) {
+    if (!value) {
+        std::cerr << file << "("s << line << "): ASSERT("s << expr_str << ") failed. "s << hint << std::endl;
+        std::abort();
+    }
+}
+
+#define ASSERT_HINT(expr, hint) AssertImpl(static_cast<bool>(expr), #expr, __FILE__, __LINE__, (hint))
+
+void AssertSameDocuments(const std::vector<Document>& lhs, const std::vector<Document>& rhs, const std::string& hint) {
+    ASSERT_HINT(lhs.size() == rhs.size(), hint);
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        ASSERT_HINT(lhs[i].id == rhs[i].id, hint);
+        ASSERT_HINT(std::abs(lhs[i].relevance - rhs[i].relevance) < 1e-9, hint);
+        ASSERT_HINT(lhs[i].rating == rhs[i].rating, hint);
+    }
+}
+
+using Predicate = std::function<bool(int, DocumentStatus, int)>;
+
+// Фильтр может сам выполнять запросы к тому же серверу: вложенный запрос
+// не должен портить состояние внешнего
+void TestNestedQueries() {
+    SearchServer search_server("and"s);
+    for (int id = 0; id < 200; ++id) {
+        const std::string text = id % 2 == 0 ? "cat fish"s : "cat dog dog"s;
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 7 });
+    }
+
+    const Predicate all = [](int, DocumentStatus, int) {
+        return true;
+    };
+    const Predicate nested = [&search_server, &all](int, DocumentStatus, int) {
+        search_server.FindTopDocuments("dog"s, all);
+        return true;
+    };
+
+    const auto expected = search_server.FindTopDocuments("cat fish"s, all);
+    ASSERT_HINT(!expected.empty(), "запрос должен что-то находить"s);
+    AssertSameDocuments(search_server.FindTopDocuments("cat fish"s, nested), expected,
+        "вложенный запрос в фильтре меняет результат внешнего"s);
+    AssertSameDocuments(search_server.FindTopDocuments(std::execution::par, "cat fish"s, nested),
+        search_server.FindTopDocuments(std::execution::par, "cat fish"s, all),
+        "вложенный запрос в фильтре меняет результат внешнего параллельного"s);
+}
+
+// Запросы без результатов считаются за промежуток времени, а не за
+// последние 1440 запросов, и выпадают из счёта, когда окно их минует
+void TestRequestQueueWindow() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "curly cat"s, DocumentStatus::ACTUAL, { 1 });
+
+    const auto window = std::chrono::milliseconds(300);
+    RequestQueue request_queue(search_server, window);
+    for (int i = 0; i < 2000; ++i) {
+        request_queue.AddFindRequest("dog"s);
+    }
+    request_queue.AddFindRequest("cat"s);
+    ASSERT_HINT(request_queue.GetNoResultRequests() == 2000, "учитываются все пустые запросы в окне"s);
+    const RequestStats stats = request_queue.GetStats();
+    ASSERT_HINT(stats.request_count == 2001 && stats.no_result_count == 2000, "статистика учитывает все запросы в окне"s);
+
+    std::this_thread::sleep_for(window + window / REQUEST_WINDOW_BUCKET_COUNT);
+    ASSERT_HINT(request_queue.GetNoResultRequests() == 0, "запросы старше окна не учитываются"s);
+    request_queue.AddFindRequest("dog"s, DocumentStatus::ACTUAL);
+    ASSERT_HINT(request_queue.GetNoResultRequests() == 1, "интервал, вышедший из окна, используется заново"s);
+}
+
+// Обход id идёт по версии, взятой в begin(): изменения во время обхода его
+// не портят, а следующий обход их видит
+void TestDocumentIdSnapshot() {
+    SearchServer search_server("and"s);
+    for (const int document_id : { 5, 1, 3 }) {
+        search_server.AddDocument(document_id, "curly cat"s, DocumentStatus::ACTUAL, { 1 });
+    }
+    search_server.RemoveDocument(3);
+
+    std::vector<int> document_ids;
+    for (auto it = search_server.begin(); it != search_server.end(); ++it) {
+        search_server.AddDocument(*it + 10, "curly dog"s, DocumentStatus::ACTUAL, { 1 });
+        search_server.RemoveDocument(*it);
+        document_ids.push_back(*it);
+    }
+    ASSERT_HINT((document_ids == std::vector<int>{ 1, 5 }), "обход видит изменения, сделанные во время него"s);
+    ASSERT_HINT((std::vector<int>(search_server.begin(), search_server.end()) == std::vector<int>{ 11, 15 }),
+        "новый обход не видит изменений"s);
+}
+
+std::string ReadFile(const std::string& path) {
+    std::ifstream input(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const std::string& path, const std::string& contents) {
+    std::ofstream output(path, std::ios::binary);
+    output.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+}
+
+// Запросы, на которых сравниваются сохранённый и открытый индексы
+void RunIndexQueries(const SearchServer& search_server, std::vector<std::vector<Document>>& results) {
+    for (const std::string& query : { "cat -dog"s, "fish bird"s, "curly tail cat"s }) {
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED }) {
+            results.push_back(search_server.FindTopDocuments(query, status));
+        }
+    }
+    for (const int document_id : search_server) {
+        search_server.GetWordFrequencies(document_id);
+        search_server.MatchDocument("cat fish"s, document_id);
+    }
+}
+
+// Открытый индекс отвечает так же, как сохранённый, повторное сохранение
+// даёт тот же файл байт в байт, а испорченный файл либо не открывается,
+// либо отвечает на запросы, не выходя за свои массивы
+void TestIndexFileRoundTrip() {
+    SearchServer search_server("and"s);
+    const std::vector<std::string> words = { "cat"s, "dog"s, "fish"s, "bird"s, "tail"s, "curly"s };
+    for (int id = 0; id < 300; ++id) {
+        std::string text = "and"s;
+        for (int i = 0; i <= id % 5; ++i) {
+            text += " "s + words[(id * 7 + i * 3) % words.size()];
+        }
+        search_server.AddDocument(id * 2, text, static_cast<DocumentStatus>(id % 3), { id % 11, -(id % 4) });
+    }
+    for (int id = 0; id < 600; id += 10) {
+        search_server.RemoveDocument(id);
+    }
+
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_test.idx").string();
+    const std::string copy_path = path + ".copy"s;
+    search_server.Save(path);
+    const std::string saved = ReadFile(path);
+    std::vector<std::vector<Document>> expected;
+    RunIndexQueries(search_server, expected);
+    {
+        const SearchServer opened = SearchServer::Open(path);
+        ASSERT_HINT(opened.GetDocumentCount() == search_server.GetDocumentCount(), "открытый индекс теряет документы"s);
+        std::vector<std::vector<Document>> results;
+        RunIndexQueries(opened, results);
+        ASSERT_HINT(results.size() == expected.size(), "открытый индекс отвечает иначе"s);
+        for (size_t i = 0; i < results.size(); ++i) {
+            AssertSameDocuments(results[i], expected[i], "открытый индекс отвечает иначе"s);
+        }
+        for (const int document_id : search_server) {
+            ASSERT_HINT(opened.GetWordFrequencies(document_id) == search_server.GetWordFrequencies(document_id),
+                "открытый индекс хранит другие частоты слов"s);
+            ASSERT_HINT(opened.MatchDocument("cat fish"s, document_id) == search_server.MatchDocument("cat fish"s, document_id),
+                "открытый индекс сопоставляет запрос иначе"s);
+        }
+        opened.Save(copy_path);
+        ASSERT_HINT(ReadFile(copy_path) == saved, "сохранение открытого индекса даёт другой файл"s);
+    }
+    search_server.Save(copy_path);
+    ASSERT_HINT(ReadFile(copy_path) == saved, "повторное сохранение даёт другой файл"s);
+
+    for (const size_t size : { size_t{ 0 }, size_t{ 8 }, saved.size() / 2, saved.size() - 8 }) {
+        WriteFile(path, saved.substr(0, size));
+        bool rejected = false;
+        try {
+            SearchServer::Open(path);
+        }
+        catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        ASSERT_HINT(rejected, "обрезанный файл индекса открывается"s);
+    }
+    for (size_t offset = 0; offset < saved.size(); offset += 8) {
+        std::string damaged = saved;
+        std::fill(damaged.begin() + offset, damaged.begin() + std::min(offset + 8, damaged.size()), '\xff');
+        WriteFile(path, damaged);
+        try {
+            const SearchServer opened = SearchServer::Open(path);
+            std::vector<std::vector<Document>> results;
+            RunIndexQueries(opened, results);
+        }
+        catch (const std::runtime_error&) {
+        }
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(copy_path);
+}
+
+// Слияние выбрасывает удалённые документы вместе с их номерами, а
+// сохранение — слова, оставшиеся только в удалённых документах: индекс, из
+// которого удалено почти всё, занимает в файле столько же, сколько индекс
+// только из оставшихся документов, и отвечает так же
+void TestRemovedDocumentsCompaction() {
+    SearchServer search_server("and"s);
+    SearchServer kept_server("and"s);
+    for (int id = 0; id < 2000; ++id) {
+        const std::string text = "cat"s + std::to_string(id % 7) + " dog"s + std::to_string(id % 13) + " fish"s;
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 5 });
+        if (id % 20 == 0) {
+            kept_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 5 });
+        }
+    }
+    for (int id = 0; id < 2000; ++id) {
+        if (id % 20 != 0) {
+            search_server.RemoveDocument(id);
+        }
+    }
+    search_server.AddDocument(5000, "cat1 dog1"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.RemoveDocument(5000);
+    for (int id = 6000; id < 6500; ++id) {
+        search_server.AddDocument(id, "cat1 rare"s + std::to_string(id) + std::string(40, 'x'), DocumentStatus::ACTUAL, { 1 });
+    }
+    for (int id = 6000; id < 6500; ++id) {
+        search_server.RemoveDocument(id);
+    }
+
+    ASSERT_HINT(search_server.GetDocumentCount() == kept_server.GetDocumentCount(), "удалённые документы учитываются"s);
+    for (const std::string& query : { "cat1 dog2"s, "fish -cat3"s, "dog12 cat0"s }) {
+        AssertSameDocuments(search_server.FindTopDocuments(query), kept_server.FindTopDocuments(query),
+            "после удаления индекс отвечает иначе"s);
+        AssertSameDocuments(search_server.FindTopDocuments(std::execution::par, query),
+            kept_server.FindTopDocuments(query), "после удаления параллельный поиск отвечает иначе"s);
+    }
+    for (const int document_id : kept_server) {
+        ASSERT_HINT(search_server.MatchDocument("cat0 fish"s, document_id) == kept_server.MatchDocument("cat0 fish"s, document_id),
+            "после удаления документ сопоставляется иначе"s);
+    }
+
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_compaction.idx").string();
+    search_server.Save(path);
+    const size_t size = ReadFile(path).size();
+    {
+        const SearchServer opened = SearchServer::Open(path);
+        for (const std::string& query : { "cat1 dog2"s, "fish -cat3"s, "rare6001"s + std::string(40, 'x') }) {
+            AssertSameDocuments(opened.FindTopDocuments(query), kept_server.FindTopDocuments(query),
+                "после сохранения без мёртвых слов индекс отвечает иначе"s);
+        }
+        for (const int document_id : kept_server) {
+            ASSERT_HINT(opened.GetWordFrequencies(document_id) == kept_server.GetWordFrequencies(document_id),
+                "после сохранения без мёртвых слов документ хранит другие слова"s);
+        }
+    }
+    kept_server.Save(path);
+    const size_t kept_size = ReadFile(path).size();
+    std::filesystem::remove(path);
+    ASSERT_HINT(size < kept_size + kept_size / 4, "удалённые документы занимают место в индексе"s);
+}
+
+// Документы, добавленные по одному, проходят через головной сегмент и его
+// запечатывание, но индекс отвечает так же, как построенный одним пакетом.
+// Документ, удалённый и добавленный снова в ту же голову, находится по id
+// и после запечатывания.
+void TestHeadSegmentSealing() {
+    SearchServer search_server("and"s);
+    std::vector<std::string> texts;
+    std::vector<NewDocument> documents;
+    const int document_count = static_cast<int>(HEAD_SEGMENT_MAX_DOCUMENTS) + 300;
+    for (int id = 0; id < document_count; ++id) {
+        texts.push_back("cat"s + std::to_string(id % 7) + " dog"s + std::to_string(id % 11) + (id % 3 == 0 ? " fish"s : " bird"s));
+    }
+    for (int id = 0; id < document_count; ++id) {
+        const auto status = id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        search_server.AddDocument(id, texts[id], status, { id % 9 });
+        documents.push_back({ id, texts[id], status, { id % 9 } });
+        if (id == 10) {
+            search_server.RemoveDocument(10);
+            search_server.AddDocument(10, texts[10], status, { 10 % 9 });
+        }
+    }
+    SearchServer batch_server("and"s);
+    batch_server.AddDocuments(documents);
+    for (const int id : { 3, 4000, document_count - 1 }) {
+        search_server.RemoveDocument(id);
+        batch_server.RemoveDocument(id);
+    }
+
+    ASSERT_HINT(search_server.GetDocumentCount() == batch_server.GetDocumentCount(), "голова теряет документы"s);
+    for (const std::string& query : { "cat1 dog2"s, "fish -cat3"s, "dog10 bird"s }) {
+        AssertSameDocuments(search_server.FindTopDocuments(query), batch_server.FindTopDocuments(query),
+            "голова отвечает иначе"s);
+        AssertSameDocuments(search_server.FindTopDocuments(query, DocumentStatus::BANNED, 1000),
+            batch_server.FindTopDocuments(query, DocumentStatus::BANNED, 1000), "голова отвечает иначе по статусу"s);
+        AssertSameDocuments(search_server.FindTopDocuments(std::execution::par, query),
+            batch_server.FindTopDocuments(query), "параллельный поиск по голове отвечает иначе"s);
+    }
+    for (const int document_id : { 0, 10, 2000, document_count - 2 }) {
+        ASSERT_HINT(search_server.MatchDocument("cat3 fish"s, document_id) == batch_server.MatchDocument("cat3 fish"s, document_id),
+            "документ головы сопоставляется иначе"s);
+        ASSERT_HINT(search_server.GetWordFrequencies(document_id) == batch_server.GetWordFrequencies(document_id),
+            "документ головы хранит другие частоты слов"s);
+    }
+}
+
+// Разбиение по 16 байт даёт те же слова, что и посимвольное SplitIntoWords,
+// и находит управляющий символ в любой позиции: в блоке и в хвосте
+void AssertSplitMatchesScalar(const std::string& text) {
+    const std::vector<std::string> expected = SplitIntoWords(text);
+    const std::vector<std::string_view> words = SplitIntoWordsView(text);
+    ASSERT_HINT(std::vector<std::string>(words.begin(), words.end()) == expected, "разбиение на слова расходится: \""s + text + "\""s);
+
+    std::vector<std::string_view> valid_words;
+    const bool has_control = std::any_of(text.begin(), text.end(), [](char c) {
+        return c >= '\0' && c < ' ';
+        });
+    ASSERT_HINT(SplitIntoValidWordsView(text, valid_words) != has_control, "управляющий символ пропущен или найден зря"s);
+    if (!has_control) {
+        ASSERT_HINT(std::vector<std::string>(valid_words.begin(), valid_words.end()) == expected,
+            "разбиение с проверкой расходится: \""s + text + "\""s);
+    }
+}
+
+void TestSplitIntoWords() {
+    for (const std::string& text : {
+        ""s, " "s, "cat"s, "  cat   dog  "s, "   leading"s, "trailing   "s,
+        "0123456789abcdef"s, "0123456789abcde "s, " 123456789abcdef"s,
+        "0123456789abcdef0123456789abcdef"s, "0123456789abcdef 123456789abcdef"s,
+        "short words cross the sixteen byte boundary here"s, "                                "s,
+        "\xD0\xBA\xD0\xBE\xD1\x82 \xFF\x80 caf\xE9  \xC0\xC1\xC2\xC3\xC4\xC5\xC6\xC7\xC8\xC9\xCA\xCB\xCC\xCD\xCE\xCF"s }) {
+        AssertSplitMatchesScalar(text);
+    }
+
+    // Слова и пробелы всех длин вокруг границ блоков, с байтами больше 127
+    const std::string alphabet = "  ab\xE9\x80"s;
+    uint32_t seed = 1;
+    for (int i = 0; i < 2000; ++i) {
+        std::string text;
+        seed = seed * 1103515245u + 12345u;
+        const size_t size = (seed >> 16) % 64;
+        for (size_t j = 0; j < size; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            text += alphabet[(seed >> 16) % alphabet.size()];
+        }
+        AssertSplitMatchesScalar(text);
+        if (!text.empty()) {
+            text[(seed >> 8) % text.size()] = '\t';
+            AssertSplitMatchesScalar(text);
+        }
+    }
+}
+
+// Кеш отдаёт только результаты, посчитанные на текущей версии индекса, и
+// не путает запросы, различающиеся статусом, политикой или max_count
+void TestQueryCache() {
+    SearchServer search_server("and"s);
+    SearchServer uncached_server("and"s);
+    for (int id = 0; id < 40; ++id) {
+        const std::string text = "cat"s + std::to_string(id % 3) + (id % 2 == 0 ? " dog"s : " fish"s);
+        const auto status = static_cast<DocumentStatus>(id % 3);
+        search_server.AddDocument(id, text, status, { id });
+        uncached_server.AddDocument(id, text, status, { id });
+    }
+    search_server.SetQueryCacheCapacity(64);
+
+    const auto check = [&](const std::string& query, DocumentStatus status, size_t max_count, bool is_parallel,
+        uint64_t hits, uint64_t misses, const std::string& hint) {
+        const auto documents = is_parallel
+            ? search_server.FindTopDocuments(std::execution::par, query, status, max_count)
+            : search_server.FindTopDocuments(query, status, max_count);
+        AssertSameDocuments(documents, uncached_server.FindTopDocuments(query, status, max_count), hint);
+        const QueryCacheStats stats = search_server.GetQueryCacheStats();
+        ASSERT_HINT(stats.hits == hits && stats.misses == misses, hint + ": неверные счётчики кеша"s);
+    };
+
+    check("cat1 dog"s, DocumentStatus::ACTUAL, 5, false, 0, 1, "первый запрос"s);
+    check("cat1 dog"s, DocumentStatus::ACTUAL, 5, false, 1, 1, "повторный запрос"s);
+    check("dog cat1 dog"s, DocumentStatus::ACTUAL, 5, false, 2, 1, "тот же запрос в другом порядке"s);
+    check("cat1 dog"s, DocumentStatus::BANNED, 5, false, 2, 2, "другой статус"s);
+    check("cat1 dog"s, DocumentStatus::ACTUAL, 5, true, 2, 3, "другая политика"s);
+    check("cat1 dog"s, DocumentStatus::ACTUAL, 2, false, 2, 4, "другой max_count"s);
+    check("cat1 dog"s, DocumentStatus::ACTUAL, 2, false, 3, 4, "повтор с другим max_count"s);
+
+    search_server.AddDocument(100, "cat1 dog dog"s, DocumentStatus::ACTUAL, { 100 });
+    uncached_server.AddDocument(100, "cat1 dog dog"s, DocumentStatus::ACTUAL, { 100 });
+    check("cat1 dog"s, DocumentStatus::ACTUAL, 5, false, 3, 5, "после добавления"s);
+    check("cat1 dog"s, DocumentStatus::ACTUAL, 5, false, 4, 5, "повтор после добавления"s);
+
+    search_server.RemoveDocument(100);
+    uncached_server.RemoveDocument(100);
+    check("cat1 dog"s, DocumentStatus::ACTUAL, 5, false, 4, 6, "после удаления"s);
+    search_server.RemoveDocument(4);
+    uncached_server.RemoveDocument(4);
+    check("cat1 dog"s, DocumentStatus::ACTUAL, 5, false, 4, 7, "после удаления из середины"s);
+}
+
+// Корпус из файла загружается так же, как те же документы, добавленные
+// по одному: с переводами строк CRLF, пустыми строками, последней строкой
+// без перевода и пакетами меньше корпуса. Ошибочная строка называется по
+// номеру, а пакеты до неё остаются в сервере.
+void TestLoadCorpus() {
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_corpus.tsv").string();
+    const std::vector<std::string> statuses = { "ACTUAL"s, "IRRELEVANT"s, "BANNED"s, "REMOVED"s };
+    SearchServer expected_server("and"s);
+    std::string corpus;
+    for (int id = 0; id < 10; ++id) {
+        const std::string text = "cat"s + std::to_string(id % 4) + " and dog"s + std::to_string(id % 3);
+        expected_server.AddDocument(id, text, static_cast<DocumentStatus>(id % 4), { id, -id / 2 });
+        corpus += std::to_string(id) + "\t"s + statuses[id % 4] + "\t"s + std::to_string(id) + " "s + std::to_string(-id / 2)
+            + "\t"s + text + (id == 9 ? ""s : id % 2 == 0 ? "\r\n"s : "\n"s) + (id == 4 ? "\n\r\n"s : ""s);
+    }
+
+    for (const size_t batch_size : { size_t{ 1 }, size_t{ 3 }, size_t{ 100 } }) {
+        WriteFile(path, corpus);
+        SearchServer search_server("and"s);
+        LoadCorpus(search_server, path, batch_size);
+        ASSERT_HINT(search_server.GetDocumentCount() == expected_server.GetDocumentCount(), "корпус загружен не полностью"s);
+        for (const int document_id : expected_server) {
+            ASSERT_HINT(search_server.GetWordFrequencies(document_id) == expected_server.GetWordFrequencies(document_id),
+                "текст документа из корпуса разобран иначе"s);
+        }
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED }) {
+            AssertSameDocuments(search_server.FindTopDocuments("cat1 dog2 cat3"s, status),
+                expected_server.FindTopDocuments("cat1 dog2 cat3"s, status), "рейтинг или статус из корпуса разобран иначе"s);
+        }
+    }
+
+    WriteFile(path, ""s);
+    SearchServer empty_server("and"s);
+    LoadCorpus(empty_server, path);
+    ASSERT_HINT(empty_server.GetDocumentCount() == 0, "пустой корпус даёт документы"s);
+
+    const std::string good_lines = "1\tACTUAL\t1\tcat\n2\tBANNED\t\tdog\r\n"s;
+    for (const std::string& bad_line : { "3\tACTUAL\tcat"s, "x\tACTUAL\t1\tcat"s, "3\tGOOD\t1\tcat"s,
+        "3\tACTUAL\t1 y\tcat"s, "3\tACTUAL\t1\tca\x01t"s }) {
+        WriteFile(path, good_lines + bad_line + "\n4\tACTUAL\t1\tfish\n"s);
+        SearchServer search_server("and"s);
+        std::string message;
+        try {
+            LoadCorpus(search_server, path, 1);
+        }
+        catch (const std::invalid_argument& e) {
+            message = e.what();
+        }
+        ASSERT_HINT(!message.empty(), "ошибочная строка корпуса принята: "s + bad_line);
+        if (bad_line.find('\x01') == std::string::npos) {
+            ASSERT_HINT(message.find("строке 3 "s) != std::string::npos, "ошибка названа не той строкой: "s + message);
+        }
+        ASSERT_HINT(search_server.GetDocumentCount() == 2, "пакеты до ошибочной строки потеряны"s);
+    }
+    std::filesystem::remove(path);
+}
+
+// Общий буфер ProcessQueriesJoined и потоковая выдача дают то же, что
+// ProcessQueries, в том числе для результатов больше участка, заранее
+// зарезервированного под запрос, и для пустого списка запросов
+void TestProcessQueriesJoined() {
+    SearchServer search_server("and"s);
+    for (int id = 0; id < 300; ++id) {
+        search_server.AddDocument(id, "cat and dog"s + std::to_string(id % 7) + " fish"s + std::to_string(id % 50),
+            DocumentStatus::ACTUAL, { id % 11 });
+    }
+    const std::vector<std::string> queries = { "fish3"s, "cat"s, "nothing"s, "dog1 -fish8"s, "fish3 fish4"s, "dog5"s };
+
+    QueryExecutor executor(4);
+    QueryExecutor single_executor(1);
+    const std::vector<std::vector<Document>> expected = ProcessQueries(executor, search_server, queries);
+    ASSERT_HINT(expected.size() == queries.size(), "ProcessQueries потерял запросы"s);
+    std::vector<Document> expected_joined;
+    for (size_t index = 0; index < queries.size(); ++index) {
+        AssertSameDocuments(expected[index], search_server.FindTopDocuments(queries[index]), "ProcessQueries: "s + queries[index]);
+        expected_joined.insert(expected_joined.end(), expected[index].begin(), expected[index].end());
+    }
+
+    const std::list<Document> joined_list = ProcessQueriesJoined(search_server, queries);
+    AssertSameDocuments({ joined_list.begin(), joined_list.end() }, expected_joined, "ProcessQueriesJoined списком"s);
+
+    // 200 больше участка в 64 документа, поэтому запрос "cat" хранится отдельно
+    for (const size_t max_count : { static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT), size_t{ 200 } }) {
+        const JoinedDocuments joined = ProcessQueriesJoined(executor, search_server, queries, max_count);
+        ASSERT_HINT(joined.GetQueryCount() == queries.size(), "в общем буфере не то число запросов"s);
+        const Document* next = joined.begin();
+        for (size_t index = 0; index < queries.size(); ++index) {
+            const ArrayView<Document> documents = joined.GetQueryDocuments(index);
+            ASSERT_HINT(documents.begin() == next, "результаты запросов в буфере не вплотную"s);
+            next = documents.end();
+            AssertSameDocuments({ documents.begin(), documents.end() },
+                search_server.FindTopDocuments(queries[index], DocumentStatus::ACTUAL, max_count),
+                "ProcessQueriesJoined: "s + queries[index] + " / "s + std::to_string(max_count));
+        }
+        ASSERT_HINT(next == joined.end() && joined.size() == static_cast<size_t>(joined.end() - joined.begin()),
+            "в буфере лишние документы"s);
+        if (max_count == 200) {
+            ASSERT_HINT(joined.GetQueryDocuments(1).size() == 200, "результат больше участка обрезан"s);
+        }
+    }
+
+    for (QueryExecutor* streamed_executor : { &executor, &single_executor }) {
+        std::mutex mutex;
+        std::vector<size_t> order;
+        std::vector<std::vector<Document>> streamed(queries.size());
+        ProcessQueriesStreamed(*streamed_executor, search_server, queries, [&](size_t index, std::vector<Document> documents) {
+            std::lock_guard guard(mutex);
+            order.push_back(index);
+            streamed[index] = std::move(documents);
+            });
+        std::vector<size_t> sorted_order = order;
+        std::sort(sorted_order.begin(), sorted_order.end());
+        ASSERT_HINT(sorted_order.size() == queries.size() && std::adjacent_find(sorted_order.begin(), sorted_order.end()) == sorted_order.end(),
+            "потоковая выдача пропускает или повторяет запросы"s);
+        // Без рабочих потоков пакет выполняется вызывающим потоком по порядку
+        if (streamed_executor == &single_executor) {
+            ASSERT_HINT(order == sorted_order, "однопоточная потоковая выдача не по порядку"s);
+        }
+        for (size_t index = 0; index < queries.size(); ++index) {
+            AssertSameDocuments(streamed[index], expected[index], "ProcessQueriesStreamed: "s + queries[index]);
+        }
+    }
+
+    const std::vector<std::string> no_queries;
+    ASSERT_HINT(ProcessQueries(executor, search_server, no_queries).empty(), "пустой пакет дал результаты"s);
+    ASSERT_HINT(ProcessQueriesJoined(search_server, no_queries).empty(), "пустой пакет дал документы"s);
+    const JoinedDocuments no_documents = ProcessQueriesJoined(executor, search_server, no_queries);
+    ASSERT_HINT(no_documents.GetQueryCount() == 0 && no_documents.empty(), "пустой пакет дал документы в буфере"s);
+    bool consumer_called = false;
+    ProcessQueriesStreamed(executor, search_server, no_queries, [&consumer_called](size_t, std::vector<Document>) {
+        consumer_called = true;
+        });
+    ASSERT_HINT(!consumer_called, "пустой пакет вызвал потребителя"s);
+}
+
+// Последовательный запрос с отсечением Block-Max WAND возвращает те же
+// лучшие документы, что и полный параллельный перебор: при равной
+// релевантности и рейтинге порядок решает id, минус-слова и удалённые
+// документы учитываются так же
+void TestPrunedTopDocuments() {
+    SearchServer search_server("and"s);
+    std::vector<std::string> texts;
+    std::vector<NewDocument> documents;
+    const int document_count = static_cast<int>(DYNAMIC_PRUNING_MIN_POSTINGS) + 3000;
+    for (int id = 0; id < document_count; ++id) {
+        std::string text = "dog"s + std::to_string(id % 5);
+        for (int i = 0; i <= id % 3; ++i) {
+            text += " cat"s;
+        }
+        text += id % 7 == 0 ? " fish"s : ""s;
+        text += id % 4 == 0 ? " bird"s : ""s;
+        texts.push_back(std::move(text));
+    }
+    for (int id = 0; id < document_count; ++id) {
+        documents.push_back({ id, texts[id], id % 9 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 2 } });
+    }
+    // Часть документов в запечатанном сегменте, остальные в голове
+    search_server.AddDocuments({ documents.begin(), documents.begin() + 5000 });
+    for (auto it = documents.begin() + 5000; it != documents.end(); ++it) {
+        search_server.AddDocument(it->id, it->text, it->status, it->ratings);
+    }
+
+    const auto odd_id = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 1;
+    };
+    const auto check = [&](const std::string& hint) {
+        for (const std::string& query : { "cat"s, "cat dog3"s, "cat fish -dog1"s, "bird cat -fish -dog4"s }) {
+            for (const size_t max_count : { size_t{ 1 }, size_t{ 5 }, size_t{ 37 }, size_t{ 500 } }) {
+                const std::string query_hint = hint + ": "s + query + " / "s + std::to_string(max_count);
+                AssertSameDocuments(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_count),
+                    search_server.FindTopDocuments(std::execution::par, query, DocumentStatus::ACTUAL, max_count), query_hint);
+                AssertSameDocuments(search_server.FindTopDocuments(query, odd_id, max_count),
+                    search_server.FindTopDocuments(std::execution::par, query, odd_id, max_count), query_hint + " с фильтром"s);
+            }
+        }
+    };
+    check("отсечение"s);
+
+    // Удаляются лучшие документы, в том числе часть группы с равной релевантностью
+    const std::vector<Document> best = search_server.FindTopDocuments(std::execution::par, "cat fish -dog1"s, DocumentStatus::ACTUAL, 50);
+    ASSERT_HINT(best.size() == 50 && std::abs(best[0].relevance - best[1].relevance) < EPSILON, "в выдаче нет равных документов"s);
+    for (size_t i = 0; i < best.size(); i += 2) {
+        search_server.RemoveDocument(best[i].id);
+    }
+    check("отсечение после удаления"s);
+}
+
+// Пакет, запущенный из задачи другого пакета, и пакеты из разных потоков
+// выполняют каждую задачу ровно один раз, а исключение из задачи выходит из
+// ForEachIndex и не ломает пул
+void TestQueryExecutor() {
+    for (const bool pin_workers : { false, true }) {
+        QueryExecutor executor(4, pin_workers);
+        ASSERT_HINT(executor.GetThreadCount() == 4, "в пуле не то число потоков"s);
+
+        const size_t outer_count = 16;
+        const size_t inner_count = 1000;
+        std::vector<std::atomic<int>> calls(outer_count * inner_count);
+        executor.ForEachIndex(outer_count, [&](size_t outer) {
+            executor.ForEachIndex(inner_count, [&](size_t inner) {
+                calls[outer * inner_count + inner].fetch_add(1, std::memory_order_relaxed);
+                });
+            });
+        ASSERT_HINT(std::all_of(calls.begin(), calls.end(), [](const std::atomic<int>& count) {
+            return count.load() == 1;
+            }), "вложенный пакет выполняет задачи не по одному разу"s);
+
+        std::vector<std::thread> threads;
+        std::vector<std::vector<std::atomic<int>>> batch_calls(4);
+        for (auto& batch : batch_calls) {
+            batch = std::vector<std::atomic<int>>(20000);
+        }
+        for (size_t thread = 0; thread < batch_calls.size(); ++thread) {
+            threads.emplace_back([&executor, &batch = batch_calls[thread]] {
+                executor.ForEachIndex(batch.size(), [&batch](size_t index) {
+                    batch[index].fetch_add(1, std::memory_order_relaxed);
+                    });
+                });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        for (const auto& batch : batch_calls) {
+            ASSERT_HINT(std::all_of(batch.begin(), batch.end(), [](const std::atomic<int>& count) {
+                return count.load() == 1;
+                }), "одновременные пакеты выполняют задачи не по одному разу"s);
+        }
+
+        for (const bool nested : { false, true }) {
+            std::string message;
+            try {
+                const auto task = [](size_t index) {
+                    if (index == 500) {
+                        throw std::runtime_error("ошибка задачи"s);
+                    }
+                };
+                if (nested) {
+                    executor.ForEachIndex(8, [&executor, &task](size_t outer) {
+                        executor.ForEachIndex(outer == 5 ? 1000 : 10, task);
+                        });
+                }
+                else {
+                    executor.ForEachIndex(1000, task);
+                }
+            }
+            catch (const std::runtime_error& e) {
+                message = e.what();
+            }
+            ASSERT_HINT(message == "ошибка задачи"s, "исключение из задачи не вышло из пакета"s);
+        }
+        std::atomic<size_t> after_error{ 0 };
+        executor.ForEachIndex(1000, [&after_error](size_t) {
+            after_error.fetch_add(1, std::memory_order_relaxed);
+            });
+        ASSERT_HINT(after_error.load() == 1000, "после исключения пул выполняет пакет не полностью"s);
+    }
+}
+
+// Отклонение при постановке в очередь заполняет future сразу, поэтому
+// с wait_for_ready = false неготовый результат считается не ошибкой
+template <typename Error>
+bool IsFailedWith(std::future<std::vector<Document>>& result, bool wait_for_ready = false) {
+    if (!wait_for_ready && result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return false;
+    }
+    try {
+        result.get();
+    }
+    catch (const Error&) {
+        return true;
+    }
+    return false;
+}
+
+// Запрос, который держит единственный поток AsyncSearchServer, пока его не
+// отпустят: пока он выполняется, очередь меняется только из теста
+class AsyncServerGate {
+public:
+    AsyncServerGate()
+        : state_(std::make_shared<State>())
+    {
+        state_->open = state_->open_promise.get_future().share();
+    }
+
+    std::future<std::vector<Document>> Submit(AsyncSearchServer& server, const std::string& query) {
+        std::future<void> started = state_->started.get_future();
+        auto result = server.Submit(query, [state = state_](int, DocumentStatus, int) {
+            if (!state->entered.exchange(true)) {
+                state->started.set_value();
+            }
+            state->open.wait();
+            return true;
+            });
+        started.wait();
+        return result;
+    }
+
+    void Open() {
+        state_->open_promise.set_value();
+    }
+
+private:
+    struct State {
+        std::promise<void> started;
+        std::atomic<bool> entered{ false };
+        std::promise<void> open_promise;
+        std::shared_future<void> open;
+    };
+
+    std::shared_ptr<State> state_;
+};
+
+// Очередь AsyncSearchServer при переполнении вытесняет запрос низшего
+// класса или отклоняет новый, SubmitWait с истёкшим сроком не ждёт места,
+// деструктор отклоняет ждущие запросы, а срок, наступивший во время обхода
+// списков вхождений, прерывает запрос
+void TestAsyncSearchServer() {
+    SearchServer search_server("and"s);
+    std::vector<std::string> texts;
+    std::vector<NewDocument> documents;
+    for (int id = 0; id < static_cast<int>(DYNAMIC_PRUNING_MIN_POSTINGS) + 1000; ++id) {
+        texts.push_back("cat dog"s + std::to_string(id % 3) + (id % 3 == 0 ? " fish"s : ""s));
+    }
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        documents.push_back({ id, texts[id], DocumentStatus::ACTUAL, { id % 5 } });
+    }
+    search_server.AddDocuments(documents);
+
+    {
+        AsyncSearchServer server(search_server, 1, 2);
+        AsyncServerGate gate;
+        auto gate_result = gate.Submit(server, "dog0"s);
+        ASSERT_HINT(server.GetQueueSize() == 0, "запрос-заглушка остался в очереди"s);
+
+        std::mutex order_mutex;
+        std::vector<std::string> order;
+        const auto recorder = [&order_mutex, &order](const std::string& name) {
+            return [&order_mutex, &order, name](int, DocumentStatus, int) {
+                std::lock_guard guard(order_mutex);
+                if (order.empty() || order.back() != name) {
+                    order.push_back(name);
+                }
+                return true;
+            };
+        };
+        auto low_first = server.Submit("dog1"s, recorder("low_first"s), QueryPriority::LOW);
+        auto low_second = server.Submit("dog1"s, recorder("low_second"s), QueryPriority::LOW);
+        auto normal = server.Submit("dog2"s, recorder("normal"s), QueryPriority::NORMAL);
+        ASSERT_HINT(IsFailedWith<QueryRejected>(low_second), "не вытеснен самый новый запрос низшего класса"s);
+        auto low_shed = server.Submit("dog1"s, QueryPriority::LOW);
+        ASSERT_HINT(IsFailedWith<QueryRejected>(low_shed), "полная очередь приняла запрос низшего класса"s);
+        auto high = server.Submit("fish"s, recorder("high"s), QueryPriority::HIGH);
+        ASSERT_HINT(IsFailedWith<QueryRejected>(low_first), "вытеснен не запрос низшего класса"s);
+        auto normal_shed = server.Submit("dog2"s, QueryPriority::NORMAL);
+        ASSERT_HINT(IsFailedWith<QueryRejected>(normal_shed), "запрос вытеснил запрос того же класса"s);
+        ASSERT_HINT(server.GetQueueSize() == 2, "очередь больше ёмкости"s);
+
+        auto expired_wait = server.SubmitWait("dog2"s, QueryPriority::HIGH, QueryDeadline(QueryDeadline::Clock::now()));
+        ASSERT_HINT(IsFailedWith<QueryDeadlineExceeded>(expired_wait), "SubmitWait с истёкшим сроком ждёт места"s);
+
+        gate.Open();
+        ASSERT_HINT(gate_result.get().size() == MAX_RESULT_DOCUMENT_COUNT, "запрос-заглушка не выполнен"s);
+        AssertSameDocuments(high.get(), search_server.FindTopDocuments("fish"s), "асинхронный запрос высшего класса"s);
+        AssertSameDocuments(normal.get(), search_server.FindTopDocuments("dog2"s), "асинхронный запрос обычного класса"s);
+        ASSERT_HINT((order == std::vector<std::string>{ "high"s, "normal"s }), "запросы выполнены не по классам"s);
+
+        // Место освободилось, и запрос с уже наступившим сроком принимается,
+        // но поток его не выполняет
+        auto expired_queued = server.SubmitWait("dog2"s, QueryPriority::NORMAL, QueryDeadline(QueryDeadline::Clock::now()));
+        ASSERT_HINT(IsFailedWith<QueryDeadlineExceeded>(expired_queued, true), "выполнен запрос с истёкшим сроком"s);
+    }
+
+    {
+        auto server = std::make_unique<AsyncSearchServer>(search_server, 1, 4);
+        AsyncServerGate gate;
+        auto gate_result = gate.Submit(*server, "dog0"s);
+        std::vector<std::future<std::vector<Document>>> pending;
+        pending.push_back(server->Submit("dog1"s));
+        pending.push_back(server->Submit("dog2"s, QueryPriority::HIGH));
+        // Деструктор отклоняет ждущие запросы до того, как ждать потоков,
+        // поэтому заглушку можно отпустить, когда они отклонены
+        std::thread opener([&pending, &gate] {
+            for (const auto& result : pending) {
+                result.wait();
+            }
+            gate.Open();
+            });
+        server.reset();
+        opener.join();
+        for (auto& result : pending) {
+            ASSERT_HINT(IsFailedWith<QueryRejected>(result), "деструктор не отклонил ждущий запрос"s);
+        }
+        ASSERT_HINT(gate_result.get().size() == MAX_RESULT_DOCUMENT_COUNT, "деструктор прервал выполняющийся запрос"s);
+    }
+
+    // Предикат задерживает первый документ до наступления срока, и запрос
+    // прерывается проверкой срока в обходе списков вхождений: "cat"
+    // обходится с отсечением, "fish" — полным перебором
+    for (const std::string& query : { "cat"s, "fish"s }) {
+        AsyncSearchServer server(search_server, 1, 1);
+        const QueryDeadline deadline = QueryDeadline::After(std::chrono::milliseconds(300));
+        auto started = std::make_shared<std::atomic<bool>>(false);
+        auto result = server.Submit(query, [started, deadline](int, DocumentStatus, int) {
+            if (!started->exchange(true)) {
+                std::this_thread::sleep_until(deadline.GetTime() + std::chrono::milliseconds(1));
+            }
+            return true;
+            }, QueryPriority::NORMAL, deadline);
+        ASSERT_HINT(IsFailedWith<QueryDeadlineExceeded>(result, true) && started->load(),
+            "срок не прервал выполняющийся запрос: "s + query);
+    }
+}
+
+// Обход и сборка ConcurrentMap одновременно с записью: значения только
+// растут, поэтому ни один ключ не может уменьшиться между двумя сборками, а
+// после записи все три способа видят одно и то же
+void TestConcurrentMap() {
+    const int thread_count = 4;
+    const int increments_per_thread = 20000;
+    const int key_count = 1000;
+    const auto get_key = [key_count](int thread, int index) {
+        return (thread * 7919 + index * 31) % key_count - key_count / 2;
+    };
+
+    ConcurrentMap<int, int> map(16);
+    std::atomic<int> running_writers{ thread_count };
+    std::vector<std::thread> writers;
+    for (int thread = 0; thread < thread_count; ++thread) {
+        writers.emplace_back([&map, &running_writers, &get_key, thread] {
+            for (int index = 0; index < increments_per_thread; ++index) {
+                ++map[get_key(thread, index)].ref_to_value;
+            }
+            running_writers.fetch_sub(1);
+            });
+    }
+
+    std::map<int, int> previous;
+    long long previous_sum = 0;
+    do {
+        // Корзины обходятся параллельно, поэтому сумма атомарна
+        std::atomic<long long> sum{ 0 };
+        map.ForEach(std::execution::par, [&sum](int, int value) {
+            sum.fetch_add(value, std::memory_order_relaxed);
+            });
+        ASSERT_HINT(sum.load() >= previous_sum, "ForEach видит меньше записей, чем раньше"s);
+        previous_sum = sum.load();
+
+        const std::vector<std::pair<int, int>> items = map.BuildOrdinaryVector(std::execution::par);
+        ASSERT_HINT(std::is_sorted(items.begin(), items.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first < rhs.first;
+            }) && std::adjacent_find(items.begin(), items.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first == rhs.first;
+            }) == items.end(), "BuildOrdinaryVector не упорядочен по ключам"s);
+
+        const std::map<int, int> current = map.BuildOrdinaryMap();
+        for (const auto& [key, value] : previous) {
+            const auto it = current.find(key);
+            ASSERT_HINT(it != current.end() && it->second >= value, "BuildOrdinaryMap потерял записи"s);
+        }
+        previous = current;
+    } while (running_writers.load() > 0);
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+
+    std::map<int, int> expected;
+    for (int thread = 0; thread < thread_count; ++thread) {
+        for (int index = 0; index < increments_per_thread; ++index) {
+            ++expected[get_key(thread, index)];
+        }
+    }
+    ASSERT_HINT(map.BuildOrdinaryMap() == expected, "BuildOrdinaryMap после записи"s);
+    const std::vector<std::pair<int, int>> items = map.BuildOrdinaryVector(std::execution::par);
+    ASSERT_HINT((items == std::vector<std::pair<int, int>>(expected.begin(), expected.end())), "BuildOrdinaryVector после записи"s);
+    std::map<int, int> visited;
+    std::mutex visited_mutex;
+    map.ForEach(std::execution::par, [&visited, &visited_mutex](int key, int value) {
+        std::lock_guard guard(visited_mutex);
+        visited.emplace(key, value);
+        });
+    ASSERT_HINT(visited == expected, "ForEach после записи"s);
+
+    ASSERT_HINT(map.Erase(-key_count / 2) == 1 && map.Erase(-key_count / 2) == 0, "Erase удаляет не по одному разу"s);
+    expected.erase(-key_count / 2);
+    ASSERT_HINT(map.BuildOrdinaryMap() == expected, "после Erase"s);
+}
+
+// Копия ChunkedHashMap не меняется вместе с оригиналом, а сам он ведёт
+// себя как std::map при росте, перезаписи и удалении
+void TestChunkedHashMap() {
+    ChunkedHashMap<int, int> map;
+    std::map<int, int> expected;
+    ChunkedHashMap<int, int> snapshot;
+    std::map<int, int> expected_snapshot;
+    uint32_t state = 7;
+    for (int step = 0; step < 20000; ++step) {
+        state = state * 1103515245 + 12345;
+        const int key = static_cast<int>(state >> 8) % 3000 - 100;
+        if (state % 3 == 0) {
+            ASSERT_HINT(map.Erase(key) == (expected.erase(key) > 0), "Erase"s);
+        }
+        else {
+            map.Set(key, step);
+            expected[key] = step;
+        }
+        if (step == 5000) {
+            snapshot = map;
+            expected_snapshot = expected;
+        }
+    }
+    ASSERT_HINT(map.size() == expected.size() && snapshot.size() == expected_snapshot.size(), "размер таблицы"s);
+    for (int key = -100; key < 2900; ++key) {
+        const auto it = expected.find(key);
+        ASSERT_HINT(map.Find(key) == (it == expected.end() ? std::nullopt : std::optional<int>(it->second)), "Find"s);
+        const auto snapshot_it = expected_snapshot.find(key);
+        ASSERT_HINT(snapshot.Find(key) == (snapshot_it == expected_snapshot.end() ? std::nullopt : std::optional<int>(snapshot_it->second)),
+            "копия изменилась вместе с оригиналом"s);
+    }
+}
+
+// Документ находится по id в голове, в пакетах, после запечатывания головы
+// и после слияний, перенумеровавших сегменты, а удалённый id можно добавить
+// снова; сверяется с моделью на std::map
+void TestDocumentLookup() {
+    SearchServer search_server("and"s);
+    std::map<int, std::string> live;
+    // Пакет держит string_view на тексты, поэтому они не должны переезжать
+    std::deque<std::string> texts;
+    uint32_t state = 1;
+    const auto next_random = [&state](uint32_t bound) {
+        state = state * 1103515245 + 12345;
+        return (state >> 8) % bound;
+    };
+    const auto make_text = [&texts](int id, int step) -> const std::string& {
+        texts.push_back("cat"s + std::to_string(id % 10) + " step"s + std::to_string(step));
+        return texts.back();
+    };
+
+    for (int step = 0; step < 12000; ++step) {
+        const uint32_t action = next_random(10);
+        const int id = static_cast<int>(next_random(3000));
+        if (action < 5) {
+            bool rejected = false;
+            try {
+                search_server.AddDocument(id, make_text(id, step), DocumentStatus::ACTUAL, { 1 });
+            }
+            catch (const std::invalid_argument&) {
+                rejected = true;
+            }
+            ASSERT_HINT(rejected == (live.count(id) > 0), "повторный id принят или новый отклонён"s);
+            if (!rejected) {
+                live[id] = texts.back();
+            }
+        }
+        else if (action < 6) {
+            std::vector<NewDocument> batch;
+            for (int batch_id = id; batch_id < id + 40; ++batch_id) {
+                if (live.count(batch_id) == 0) {
+                    batch.push_back({ batch_id, make_text(batch_id, step), DocumentStatus::ACTUAL, { 2 } });
+                    live[batch_id] = texts.back();
+                }
+            }
+            search_server.AddDocuments(batch);
+        }
+        else if (action < 9) {
+            search_server.RemoveDocument(id);
+            live.erase(id);
+        }
+        else {
+            std::vector<int> ids;
+            for (int removed_id = id; removed_id < id + 60; removed_id += 2) {
+                ids.push_back(removed_id);
+                live.erase(removed_id);
+            }
+            search_server.RemoveDocuments(ids);
+        }
+
+        if (step % 500 == 499) {
+            ASSERT_HINT(search_server.GetDocumentCount() == static_cast<int>(live.size()), "число документов"s);
+            for (int document_id = 0; document_id < 3040; ++document_id) {
+                const auto it = live.find(document_id);
+                const std::map<std::string_view, double> freqs = search_server.GetWordFrequencies(document_id);
+                if (it == live.end()) {
+                    ASSERT_HINT(freqs.empty(), "найден удалённый документ "s + std::to_string(document_id));
+                }
+                else {
+                    ASSERT_HINT(freqs.count(it->second.substr(it->second.find(' ') + 1)) > 0,
+                        "по id найден не последний документ "s + std::to_string(document_id));
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+void TestSearchServer() {
+    TestSplitIntoWords();
+    TestNestedQueries();
+    TestRequestQueueWindow();
+    TestDocumentIdSnapshot();
+    TestIndexFileRoundTrip();
+    TestRemovedDocumentsCompaction();
+    TestHeadSegmentSealing();
+    TestQueryCache();
+    TestLoadCorpus();
+    TestProcessQueriesJoined();
+    TestPrunedTopDocuments();
+    TestQueryExecutor();
+    TestAsyncSearchServer();
+    TestConcurrentMap();
+    TestChunkedHashMap();
+    TestDocumentLookup();
 }
\ No newline at end of file
@@ -8,4 +8,8 @@ void FindTopDocuments(const SearchServer& search_server, const std::string& raw_
 
 void MatchDocuments(const SearchServer& search_server, const std::string& query);
 
-void PrintMatchDocumentResult(int document_id, const std::vector<std::string_view>& words, DocumentStatus status);
\ No newline at end of file
+void PrintMatchDocumentResult(int document_id, const std::vector<std::string_view>& words, DocumentStatus status);
+
+// Проверки поведения SearchServer, которые легко сломать оптимизациями;
+// при ошибке печатают место проверки и завершают программу
+void TestSearchServer();
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "top_documents.h"
+
+TopDocumentsCollector::TopDocumentsCollector(size_t max_count)
+    : max_count_(max_count)
+{
+    heap_.reserve(max_count);
+}
+
+void TopDocumentsCollector::Add(const Document& document) {
+    if (max_count_ == 0) {
+        return;
+    }
+    if (heap_.size() < max_count_) {
+        heap_.push_back(document);
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+    else if (IsMoreRelevant(document, heap_.front())) {
+        std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+bool TopDocumentsCollector::IsFull() const {
+    return heap_.size() >= max_count_;
+}
+
+const Document& TopDocumentsCollector::GetWorst() const {
+    return heap_.front();
+}
+
+std::vector<Document> TopDocumentsCollector::ExtractSorted() {
+    std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return std::move(heap_);
+}
+
+void SelectTopDocuments(const std::execution::sequenced_policy&, std::vector<Document>& documents, size_t max_count) {
+    if (documents.size() > max_count) {
+        std::partial_sort(documents.begin(), documents.begin() + max_count, documents.end(), IsMoreRelevant);
+        documents.resize(max_count);
+    }
+    else {
+        std::sort(documents.begin(), documents.end(), IsMoreRelevant);
+    }
+}
+
+void SelectTopDocuments(const std::execution::parallel_policy& policy, std::vector<Document>& documents, size_t max_count) {
+    const size_t chunk_count = std::max(1u, std::thread::hardware_concurrency());
+    const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+    if (chunk_count == 1 || documents.size() <= max_count || chunk_size <= max_count) {
+        SelectTopDocuments(std::execution::seq, documents, max_count);
+        return;
+    }
+
+    // Каждый поток держит собственную кучу лучших документов своего куска,
+    // затем кучи сливаются в одну.
+    std::vector<TopDocumentsCollector> collectors(chunk_count, TopDocumentsCollector(max_count));
+    std::vector<size_t> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    std::for_each(policy, chunks.begin(), chunks.end(), [&](size_t chunk) {
+        const size_t begin = std::min(documents.size(), chunk * chunk_size);
+        const size_t end = std::min(documents.size(), begin + chunk_size);
+        for (size_t i = begin; i < end; ++i) {
+            collectors[chunk].Add(documents[i]);
+        }
+    });
+
+    TopDocumentsCollector result(max_count);
+    for (TopDocumentsCollector& collector : collectors) {
+        for (const Document& document : collector.ExtractSorted()) {
+            result.Add(document);
+        }
+    }
+    documents = result.ExtractSorted();
+}
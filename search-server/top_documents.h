@@ -0,0 +1,49 @@
+#pragma once
+
+#include "document.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <execution>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+inline static constexpr double EPSILON = 1e-6;
+
+// Порядок выдачи: по убыванию релевантности (с точностью до EPSILON), затем
+// по убыванию рейтинга. При полном совпадении выше идёт меньший id, чтобы
+// результат не зависел от способа отбора.
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+// Ограниченная куча из не более чем max_count лучших документов.
+// В вершине кучи лежит худший из отобранных — с ним сравнивается кандидат.
+class TopDocumentsCollector {
+public:
+    explicit TopDocumentsCollector(size_t max_count);
+
+    void Add(const Document& document);
+
+    bool IsFull() const;
+
+    const Document& GetWorst() const;
+
+    std::vector<Document> ExtractSorted();
+
+private:
+    size_t max_count_;
+    std::vector<Document> heap_;
+};
+
+void SelectTopDocuments(const std::execution::sequenced_policy& policy, std::vector<Document>& documents, size_t max_count);
+
+void SelectTopDocuments(const std::execution::parallel_policy& policy, std::vector<Document>& documents, size_t max_count);